@@ -0,0 +1,80 @@
+#ifndef NTOY_ACCUMULATOR_H
+#define NTOY_ACCUMULATOR_H
+
+#include <string>
+
+#include <osg/BlendColor>
+#include <osg/Camera>
+#include <osg/Scissor>
+#include <osg/Texture2D>
+
+namespace ntoy
+{
+
+class RenderTargetPool;
+
+// Progressive accumulation of the shadertoy quad. The quad is drawn by a pre render camera
+// into a float texture, blended with weight 1 / (toy_SampleIndex + 1), so the texture holds
+// the mean of every sample since the last reset, it's drawn on screen instead of the quad.
+// The screen can be split into bands, one band is drawn per frame, sample index advances
+// once every band is drawn.
+class Accumulator
+{
+public:
+    // Render order of the camera, after buffer passes.
+    static const int renderOrder = 4;
+
+    Accumulator(RenderTargetPool& pool);
+
+    // Draw scene through the accumulation camera under parent, and the mean on screen.
+    // scene inherits state of parent.
+    void setup(osg::Group* parent, osg::Node* scene, const std::string& vertexSource,
+        int width, int height);
+
+    bool isEnabled() const { return _parent != 0; }
+
+    // Target is reallocated, accumulation restarts.
+    void resize(int width, int height);
+
+    // Start over from sample 0 in next update.
+    void reset();
+
+    // Call it in update traversal, after reset.
+    void update();
+
+    int getSampleIndex() const { return _sampleIndex; }
+
+    // Return true if max samples are drawn, nothing is drawn until reset.
+    bool isConverged() const { return _maxSamples > 0 && _sampleIndex >= _maxSamples; }
+
+    // Stop drawing after max samples, 0 means never stop.
+    int getMaxSamples() const { return _maxSamples; }
+    void setMaxSamples(int v) { _maxSamples = v; }
+
+    // Number of bands the screen is split into, one band is drawn per frame.
+    int getNumBands() const { return _numBands; }
+    void setNumBands(int v) { _numBands = v; }
+
+private:
+    void allocateTarget();
+
+    RenderTargetPool& _pool;
+
+    int _width = 0;
+    int _height = 0;
+    int _sampleIndex = 0;
+    int _band = 0;
+    int _maxSamples = 0;
+    int _numBands = 1;
+    osg::Group* _parent = 0;
+    osg::ref_ptr<osg::Camera> _camera;
+    osg::ref_ptr<osg::Group> _display;
+    osg::ref_ptr<osg::Texture2D> _texture;
+    osg::ref_ptr<osg::BlendColor> _blendColor;
+    osg::ref_ptr<osg::Scissor> _scissor;
+    osg::ref_ptr<osg::Uniform> _sampleUniform;
+};
+
+}  // namespace ntoy
+
+#endif // NTOY_ACCUMULATOR_H
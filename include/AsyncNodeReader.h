@@ -0,0 +1,61 @@
+#ifndef NTOY_ASYNCNODEREADER_H
+#define NTOY_ASYNCNODEREADER_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <osg/Node>
+#include <osg/ref_ptr>
+
+namespace ntoy
+{
+
+// Read node files on a worker thread. Only the latest request matters: requests not yet
+// picked up by the worker are replaced by newer ones, results of superseded reads are
+// discarded. A read in progress can't be interrupted, osgDB has no way to do that.
+class AsyncNodeReader
+{
+public:
+    AsyncNodeReader();
+
+    ~AsyncNodeReader();
+
+    AsyncNodeReader(const AsyncNodeReader&) = delete;
+    AsyncNodeReader& operator=(const AsyncNodeReader&) = delete;
+
+    void request(const std::string& file);
+
+    // Return true if the latest request finished since last call, node is null if the
+    // read failed.
+    bool takeResult(std::string& file, osg::ref_ptr<osg::Node>& node);
+
+    // Called on worker thread when a result is ready to be taken.
+    void setFinishedCallback(std::function<void()> v);
+
+    // Return true if nothing is requested, being read or waiting to be taken.
+    bool isIdle() const;
+
+private:
+    void work();
+
+    bool _done = false;
+    bool _hasRequest = false;
+    bool _hasResult = false;
+    unsigned _requestId = 0;
+    unsigned _finishedId = 0;
+    std::string _requestFile;
+    std::string _resultFile;
+    osg::ref_ptr<osg::Node> _result;
+    std::function<void()> _finishedCallback;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _condition;
+    std::thread _thread;
+};
+
+}  // namespace ntoy
+
+#endif // NTOY_ASYNCNODEREADER_H
@@ -0,0 +1,73 @@
+#ifndef NTOY_BACKGROUNDCOMPILER_H
+#define NTOY_BACKGROUNDCOMPILER_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <osg/ref_ptr>
+
+namespace osg
+{
+class Drawable;
+class GraphicsContext;
+class Program;
+class State;
+class StateSet;
+}  // namespace osg
+
+namespace ntoy
+{
+
+// Compile and link programs on a compile context shared with the graphics context, so draw
+// never waits for a link. The driver is allowed to compile with multiple threads if
+// KHR_parallel_shader_compile is available. If the compile context can't be created, link
+// happens in draw traversal of the graphics context, it stalls but a broken program is
+// still never used.
+class BackgroundCompiler
+{
+public:
+    using Callback = std::function<void(osg::Program* program, bool linked)>;
+
+    BackgroundCompiler();
+
+    // Stop compile thread, close compile context.
+    ~BackgroundCompiler();
+
+    BackgroundCompiler(const BackgroundCompiler&) = delete;
+    BackgroundCompiler& operator=(const BackgroundCompiler&) = delete;
+
+    // Create compile context shared with gc, call it after gc is realized.
+    void setGraphicsContext(osg::GraphicsContext* gc);
+
+    // Link program with defines of stateSet, stateSet is copied. Callback is called by
+    // update once it's done.
+    void compile(osg::Program* program, const osg::StateSet* stateSet, Callback callback);
+
+    // Call it in update traversal.
+    void update();
+
+    // Add it under scene, it links jobs in draw traversal if there is no compile context.
+    osg::Drawable* getFallbackCompiler() { return _fallbackCompiler; }
+
+    bool hasPendingJobs() const { return !_jobs.empty(); }
+
+    struct Job;
+
+private:
+    void compileInDraw(osg::State& state);
+
+    unsigned _contextID = 0;
+    osg::ref_ptr<osg::GraphicsContext> _compileContext;
+    osg::ref_ptr<osg::Drawable> _fallbackCompiler;
+    std::vector<std::shared_ptr<Job>> _jobs;
+
+    // jobs waiting for fallback compiler
+    std::mutex _mutex;
+    std::vector<std::shared_ptr<Job>> _drawJobs;
+};
+
+}  // namespace ntoy
+
+#endif // NTOY_BACKGROUNDCOMPILER_H
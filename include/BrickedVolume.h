@@ -0,0 +1,169 @@
+#ifndef NTOY_BRICKEDVOLUME_H
+#define NTOY_BRICKEDVOLUME_H
+
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <osg/Drawable>
+#include <osg/Image>
+#include <osg/Texture3D>
+#include <osg/Vec3i>
+
+namespace ntoy
+{
+
+class MappedFile;
+class ThreadPool;
+
+// Volume too large for one texture, split into bricks in a memory mapped .bvol file. Only
+// bricks the shader touches are resident, in slots of an atlas texture sized by a memory
+// budget, least recently touched bricks are evicted first. A page table texture maps each
+// brick to its slot.
+//
+// Shader samples it with toy_SampleVolume from include <ntoy/bricked_volume.glsl>, which
+// marks every touched brick in a feedback image. The feedback is read back once per frame,
+// bricks marked but not resident are copied out of the file on a thread pool and uploaded
+// into the atlas, then enabled in the page table.
+//
+// A brick is stored with a border of 1 voxel on each side, so linear filtering is
+// seamless across bricks.
+class BrickedVolume
+{
+public:
+    // Page table is bound to this unit, atlas to the unit of --texture3d.
+    static const unsigned pageTableUnit = 15;
+
+    // Name of shader include that defines toy_SampleVolume.
+    static const char* getIncludeName();
+    static const char* getIncludeSource();
+
+    BrickedVolume();
+
+    // Wait for queued brick copies.
+    ~BrickedVolume();
+
+    BrickedVolume(const BrickedVolume&) = delete;
+    BrickedVolume& operator=(const BrickedVolume&) = delete;
+
+    // Map file, allocate atlas of at most cacheBytes. Throw std::runtime_error if file
+    // isn't a bricked volume.
+    void open(const std::string& file, std::size_t cacheBytes);
+
+    // Bind atlas to unit, page table and feedback image to state of parent, add feedback
+    // drawable to parent. filter is min and mag filter of the atlas.
+    void setup(osg::Group* parent, unsigned unit, osg::Texture::FilterMode filter);
+
+    bool isEnabled() const { return _atlas != 0; }
+
+    // Read feedback again before isIdle, view or anything else the shader reads changed.
+    void invalidate() { _quietFeedbacks = 0; }
+
+    // Call it in update traversal, start loading missing bricks, enable loaded ones.
+    // Return true if page table changed.
+    bool update();
+
+    // Return true if nothing is loading and the last few feedbacks missed nothing.
+    bool isIdle() const;
+
+    // Cut raw volume of size voxels into bricks of brickSize voxels, write them to file.
+    // Throw std::runtime_error if raw is too small or anything fails.
+    static void convert(const std::string& raw, const osg::Vec3i& size, GLenum pixelFormat,
+        GLenum dataType, const std::string& file, int brickSize = 32);
+
+private:
+    enum PageState
+    {
+        EMPTY,
+        LOADING,
+        RESIDENT
+    };
+
+    struct Page
+    {
+        PageState state = EMPTY;
+        int slot = -1;
+    };
+
+    struct Slot
+    {
+        int brick = -1;
+        // index of the feedback it was last touched in
+        unsigned touched = 0;
+        std::list<int>::iterator lru;
+    };
+
+    struct Load
+    {
+        int brick = 0;
+        int slot = 0;
+        std::future<std::vector<unsigned char>> data;
+    };
+
+    struct Upload
+    {
+        int brick = 0;
+        int slot = 0;
+        std::vector<unsigned char> data;
+    };
+
+    // Called in draw traversal, after the scene.
+    void draw(osg::RenderInfo& renderInfo);
+
+    // Return a free slot, evict least recently touched brick if there's none. Return -1 if
+    // every slot is touched by the current feedback.
+    int acquireSlot();
+
+    void setPage(int brick, int slot);
+
+    osg::Vec3i getSlotOrigin(int slot) const;
+
+    std::string _fileName;
+    std::unique_ptr<MappedFile> _file;
+    std::size_t _dataOffset = 0;
+    osg::Vec3i _size;
+    osg::Vec3i _grid;
+    int _brickSize = 0;
+    // voxels per side of a stored brick, border included
+    int _storedSize = 0;
+    std::size_t _brickBytes = 0;
+    GLenum _pixelFormat = 0;
+    GLenum _dataType = 0;
+
+    osg::Vec3i _atlasSlots;
+    osg::ref_ptr<osg::Texture3D> _atlas;
+    osg::ref_ptr<osg::Texture3D> _pageTable;
+    osg::ref_ptr<osg::Image> _pageImage;
+    osg::ref_ptr<osg::Texture3D> _feedback;
+    osg::ref_ptr<osg::Drawable> _drawable;
+
+    std::vector<Page> _pages;
+    std::vector<Slot> _slots;
+    std::vector<int> _freeSlots;
+    // slots of resident bricks, least recently touched first
+    std::list<int> _lru;
+    unsigned _feedbackIndex = 0;
+    int _quietFeedbacks = 0;
+    int _maxLoads = 64;
+    bool _cacheFullReported = false;
+    std::vector<Load> _loads;
+    std::unique_ptr<ThreadPool> _pool;
+
+    // following are accessed in draw thread.
+    mutable std::mutex _mutex;
+    std::vector<Upload> _uploads;
+    std::vector<Upload> _uploaded;
+    std::vector<unsigned char> _feedbackData;
+    std::vector<unsigned char> _zeros;
+    bool _feedbackReady = false;
+    GLuint _pbo = 0;
+    // frame of the feedback in _pbo, -1 if there's none
+    int _readFrame = -1;
+};
+
+}  // namespace ntoy
+
+#endif // NTOY_BRICKEDVOLUME_H
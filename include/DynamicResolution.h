@@ -0,0 +1,101 @@
+#ifndef NTOY_DYNAMICRESOLUTION_H
+#define NTOY_DYNAMICRESOLUTION_H
+
+#include <mutex>
+#include <string>
+
+#include <osg/Camera>
+#include <osg/GL>
+#include <osg/Texture2D>
+#include <osg/Vec2>
+
+namespace ntoy
+{
+
+class RenderTargetPool;
+
+// Draw scene into a render target at a fraction of the window size, then upscale it to the
+// window. The fraction follows gpu time of the render target camera, measured with
+// timestamp queries, towards a target frame time. The target is allocated at window size,
+// a scaled frame only uses part of it, so scale changes don't allocate anything.
+class DynamicResolution
+{
+public:
+    enum Filter
+    {
+        BILINEAR,
+        // bilinear, sharpened within the range of neighbor pixels, no halo on edges
+        SHARP
+    };
+
+    // Render order of the camera, after buffer passes.
+    static const int renderOrder = 4;
+
+    DynamicResolution(RenderTargetPool& pool);
+
+    // Draw scene through the scaled camera under parent, and the upscaled image on screen.
+    // scene inherits state of parent.
+    void setup(osg::Group* parent, osg::Node* scene, const std::string& vertexSource,
+        int width, int height);
+
+    bool isEnabled() const { return _parent != 0; }
+
+    // Window is resized, target is reallocated, scale is kept.
+    void resize(int width, int height);
+
+    // Call it in update traversal, adapt scale to the latest measured gpu time.
+    void update();
+
+    float getScale() const { return _scale; }
+
+    // Size of the scaled frame in pixels.
+    osg::Vec2 getRenderSize() const;
+
+    // Milliseconds.
+    double getTargetTime() const { return _targetTime; }
+    void setTargetTime(double v) { _targetTime = v; }
+
+    float getMinScale() const { return _minScale; }
+    void setMinScale(float v) { _minScale = v; }
+
+    Filter getFilter() const { return _filter; }
+    void setFilter(Filter v) { _filter = v; }
+
+private:
+    static const int numQueries = 4;
+
+    void beginQuery(osg::RenderInfo& renderInfo);
+
+    void endQuery(osg::RenderInfo& renderInfo);
+
+    void allocateTarget();
+
+    RenderTargetPool& _pool;
+
+    int _width = 0;
+    int _height = 0;
+    float _scale = 1;
+    float _minScale = 0.25f;
+    double _targetTime = 16;
+    Filter _filter = BILINEAR;
+    osg::Group* _parent = 0;
+    osg::ref_ptr<osg::Camera> _camera;
+    osg::ref_ptr<osg::Group> _display;
+    osg::ref_ptr<osg::Texture2D> _texture;
+    osg::ref_ptr<osg::Uniform> _sourceSizeUniform;
+    osg::ref_ptr<osg::Uniform> _windowSizeUniform;
+
+    // following are accessed in draw thread.
+    std::mutex _mutex;
+    // begin and end timestamp of frames in flight
+    GLuint _queries[numQueries][2] = {};
+    unsigned _queryFrames[numQueries] = {};
+    bool _pending[numQueries] = {};
+    int _activeQuery = -1;
+    // latest gpu time in milliseconds, -1 if update has taken it.
+    double _gpuTime = -1;
+};
+
+}  // namespace ntoy
+
+#endif // NTOY_DYNAMICRESOLUTION_H
@@ -0,0 +1,154 @@
+#ifndef NTOY_FILEWATCHER_H
+#define NTOY_FILEWATCHER_H
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+#include <osg/Referenced>
+#include <osg/ref_ptr>
+
+namespace ntoy
+{
+
+using FileSet = std::set<std::string>;
+
+struct FileWatchError : public std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+// What's compared to decide whether a file really changed.
+struct FileStamp
+{
+    long long size = -1;
+    long long mtimeSec = 0;
+    long mtimeNsec = 0;
+    std::uint64_t hash = 0;
+};
+
+// Throw FileWatchError if file can't be stat or read.
+FileStamp getFileStamp(const std::string& file, bool hashContent = false);
+
+// Backend of ResourceObserver, find out which files changed since last poll. Every added
+// file is reported once by the first poll after it's added.
+class FileWatcher : public osg::Referenced
+{
+public:
+    virtual const char* getName() const = 0;
+
+    virtual void addFile(const std::string& file) = 0;
+
+    // Insert changed files into changedFiles. Must not block.
+    virtual void poll(FileSet& changedFiles) = 0;
+
+    // Descriptor that becomes readable when something changed, -1 if there is none.
+    virtual int getFileDescriptor() const { return -1; }
+
+    // Return true if changes of some files are only found by polling, nothing wakes the
+    // caller for them.
+    virtual bool hasPolledFiles() const { return getFileDescriptor() == -1; }
+};
+
+// stat every file on every poll.
+class StatFileWatcher : public FileWatcher
+{
+public:
+    const char* getName() const override { return "stat"; }
+
+    void addFile(const std::string& file) override;
+
+    void poll(FileSet& changedFiles) override;
+
+private:
+    std::map<std::string, FileStamp> _files;
+    // files whose last stat failed
+    FileSet _failedFiles;
+};
+
+#ifdef __linux__
+
+// Watch parent directories of observed files with inotify, so a file replaced by rename
+// (write to temp then rename, as vim does) is still caught. Files whose directory can't be
+// watched are handed to a StatFileWatcher.
+class InotifyFileWatcher : public FileWatcher
+{
+public:
+    // throw FileWatchError if inotify is not available.
+    InotifyFileWatcher();
+
+    const char* getName() const override { return "inotify"; }
+
+    void addFile(const std::string& file) override;
+
+    void poll(FileSet& changedFiles) override;
+
+    int getFileDescriptor() const override { return _fd; }
+
+    // Files whose directory can't be watched are stat on every poll.
+    bool hasPolledFiles() const override { return _statWatcher != 0; }
+
+protected:
+    ~InotifyFileWatcher() override;
+
+private:
+    struct Directory
+    {
+        std::string path;
+        // simple file name : observed file names
+        std::map<std::string, FileSet> files;
+    };
+
+    void handleEvent(int wd, unsigned mask, const char* name, FileSet& changedFiles);
+
+    void fallback(const FileSet& files);
+
+    int _fd = -1;
+    std::map<int, Directory> _directories;
+    FileSet _pendingFiles;
+    osg::ref_ptr<StatFileWatcher> _statWatcher;
+};
+
+#endif
+
+// Sit between a FileWatcher and callbacks. Editors might write a file in several chunks,
+// a change is only delivered after the file has been quiet for the quiet period, and only
+// if its size, mtime or content hash differs from the last delivered one.
+class ChangeCoalescer
+{
+public:
+    // Files that have never been delivered are delivered immediately.
+    void add(const FileSet& files, double time);
+
+    // Insert settled files into settledFiles, return true if there is any.
+    bool collect(double time, FileSet& settledFiles);
+
+    // Time when the earliest pending file could settle, -1 if nothing is pending.
+    double getNextSettleTime() const;
+
+    double getQuietPeriod() const { return _quietPeriod; }
+    void setQuietPeriod(double v) { _quietPeriod = v; }
+
+    // If true, compare content hash instead of mtime, touching a file does nothing.
+    bool getHashContent() const { return _hashContent; }
+    void setHashContent(bool v) { _hashContent = v; }
+
+private:
+    bool _hashContent = false;
+    double _quietPeriod = 0.1;
+
+    // file : time of last reported change
+    std::map<std::string, double> _pendingFiles;
+    // file : stamp of last delivery
+    std::map<std::string, FileStamp> _stamps;
+};
+
+// Create inotify watcher if possible, stat watcher otherwise. Set NTOY_FILE_WATCHER to
+// "stat" to force the stat watcher.
+FileWatcher* createFileWatcher();
+
+}  // namespace ntoy
+
+#endif // NTOY_FILEWATCHER_H
@@ -0,0 +1,61 @@
+#ifndef NTOY_FRAMEPACER_H
+#define NTOY_FRAMEPACER_H
+
+#include <mutex>
+#include <vector>
+
+namespace toy
+{
+
+// Sleep to absolute deadlines on a monotonic clock, then spin the last bit, so frame
+// time doesn't jitter by scheduler granularity. Also block an idle loop until a file
+// descriptor is readable, wake is called or a requested wake time is reached.
+class FramePacer
+{
+public:
+    FramePacer();
+
+    ~FramePacer();
+
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    // Monotonic seconds.
+    double now() const;
+
+    void sleepUntil(double deadline);
+
+    // Block until something wakes the loop or timeout, timeout < 0 means forever. Return
+    // false on timeout. Readable descriptors are not read, whoever owns them must drain
+    // them.
+    bool wait(double timeout = -1);
+
+    // Wake wait when fd is readable.
+    void addFileDescriptor(int fd);
+
+    // Can be called from any thread.
+    void wake();
+
+    // Wake wait at time, an earlier time replaces a later one. Can be called from any
+    // thread.
+    void wakeAt(double time);
+
+    // Sleep stops this many seconds before deadline, spin the rest.
+    double getSpinTime() const { return _spinTime; }
+    void setSpinTime(double v) { _spinTime = v; }
+
+private:
+    void signal();
+
+    double _spinTime = 0.0005;
+    int _wakeFd = -1;
+    std::vector<int> _fds;
+
+    std::mutex _mutex;
+    bool _woken = false;
+    double _wakeTime = -1;
+};
+
+}  // namespace toy
+
+#endif // NTOY_FRAMEPACER_H
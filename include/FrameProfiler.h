@@ -0,0 +1,105 @@
+#ifndef NTOY_FRAMEPROFILER_H
+#define NTOY_FRAMEPROFILER_H
+
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <osg/GL>
+
+namespace osg
+{
+class Camera;
+class Node;
+class RenderInfo;
+}  // namespace osg
+
+namespace osgViewer
+{
+class Viewer;
+}  // namespace osgViewer
+
+namespace toy
+{
+
+struct SampleSummary
+{
+    std::size_t count = 0;
+    double min = 0;
+    double mean = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+// Nearest rank percentiles, all zero if samples is empty.
+SampleSummary summarize(std::vector<double> samples);
+
+// Record cpu event, update, cull, draw time from osg stats, and gpu time of main camera and
+// every camera in scene with GL_TIME_ELAPSED queries. Query results are read a few frames
+// later, nothing waits for them. Frames are streamed to a csv or json file, summary is
+// written when profiling finishes.
+class FrameProfiler
+{
+public:
+    // Write json if file ends with .json, csv otherwise. Throw std::runtime_error if file
+    // can't be opened.
+    explicit FrameProfiler(const std::string& file);
+
+    ~FrameProfiler();
+
+    FrameProfiler(const FrameProfiler&) = delete;
+    FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+    // Call it after each frame. Time new cameras, write frames whose samples are settled.
+    // Scene is searched for cameras when it's replaced and every 60 frames.
+    void update(osgViewer::Viewer& viewer);
+
+    // Write remaining frames and summary, nothing is recorded after it.
+    void finish(osgViewer::Viewer& viewer);
+
+    // metric : samples of written frames, metric is one of frame, event, update, cull, draw
+    // or gpu:camera_name. In milliseconds.
+    const std::map<std::string, std::vector<double>>& getSamples() const { return _samples; }
+
+private:
+    struct CameraTimer;
+
+    void attach(osg::Camera& camera, const std::string& name);
+
+    void beginQuery(osg::RenderInfo& renderInfo, CameraTimer& timer);
+
+    void endQuery(osg::RenderInfo& renderInfo, CameraTimer& timer);
+
+    void writeFrame(osgViewer::Viewer& viewer, unsigned frame);
+
+    void writeSummary();
+
+    bool _json = false;
+    bool _finished = false;
+    bool _firstFrame = true;
+    unsigned _nextFrame = 0;
+    const osg::Node* _scannedScene = 0;
+    unsigned _scanFrame = 0;
+    std::ofstream _ofs;
+
+    std::map<osg::Camera*, std::shared_ptr<CameraTimer>> _timers;
+    std::map<std::string, int> _names;
+
+    // following are accessed in draw thread.
+    std::mutex _mutex;
+    CameraTimer* _activeTimer = 0;
+    std::vector<GLuint> _freeQueries;
+    // frame : camera name : gpu time
+    std::map<unsigned, std::map<std::string, double>> _gpuTimes;
+
+    std::map<std::string, std::vector<double>> _samples;
+};
+
+}  // namespace toy
+
+#endif // NTOY_FRAMEPROFILER_H
@@ -0,0 +1,83 @@
+#ifndef NTOY_LATELATCH_H
+#define NTOY_LATELATCH_H
+
+#include <mutex>
+
+#include <osg/Drawable>
+#include <osg/Timer>
+#include <osg/Vec2>
+#include <osg/ref_ptr>
+
+namespace osg
+{
+class GraphicsContext;
+class State;
+}  // namespace osg
+
+namespace ntoy
+{
+
+class ToyBuiltins;
+
+// Sample the latest pointer position in draw traversal, right before the quad is drawn,
+// and write it into the built-ins block and the mouse uniform of the applied program.
+// Pointer events handled after update of a frame, which happens if draw runs in its own
+// thread, still make it into that frame. On X11 the pointer is queried from the window
+// instead of waiting for the next event.
+//
+// Age of a newly latched pointer is measured at latch and after SwapBuffers returns, from
+// the last delivered pointer event, so age of a queried pointer is an upper bound. Time
+// spent in display queue and scan out is not included.
+class LateLatch
+{
+public:
+    struct Latency
+    {
+        // Smoothed, in milliseconds.
+        double inputToDraw = 0;
+        double inputToPresent = 0;
+        unsigned samples = 0;
+    };
+
+    explicit LateLatch(ToyBuiltins& builtins);
+
+    // Add it right before drawables that read mouse, under the same state set.
+    osg::Drawable* getLatchDrawable() { return _latchDrawable; }
+
+    // Query pointer of gc if it's a X11 window, measure swap of gc. Call it after gc is
+    // realized.
+    void setGraphicsContext(osg::GraphicsContext* gc);
+
+    // Latest pointer position from events, tick is when the event happened.
+    void setPointer(const osg::Vec2& pointer, osg::Timer_t tick);
+
+    Latency getLatency() const;
+
+private:
+    void latch(osg::State& state);
+
+    void present();
+
+    ToyBuiltins& _builtins;
+    osg::ref_ptr<osg::Drawable> _latchDrawable;
+
+    osg::GraphicsContext* _gc = 0;
+    // X11 Display* and Window, queried in draw thread that owns the display.
+    void* _display = 0;
+    unsigned long _window = 0;
+
+    osg::Vec2 _pointer;
+    osg::Timer_t _pointerTick = 0;
+
+    // accessed in draw thread
+    osg::Vec2 _latchedPointer;
+    osg::Timer_t _latchedTick = 0;
+    bool _newInput = false;
+
+    Latency _latency;
+    mutable std::mutex _mutex;
+};
+
+}  // namespace ntoy
+
+#endif // NTOY_LATELATCH_H
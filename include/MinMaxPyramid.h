@@ -0,0 +1,28 @@
+#ifndef NTOY_MINMAXPYRAMID_H
+#define NTOY_MINMAXPYRAMID_H
+
+#include <osg/Image>
+
+namespace ntoy
+{
+
+// Min and max of the first component of a 3d image, per cell of cellSize^3 voxels, in a
+// GL_RG32F image with a full mip chain, every level holds min and max of 2x2x2 cells of the
+// level below. A cell also covers the first voxel of the next cell, so bounds hold for
+// linear filtering between them. 8 and 16 bit components are normalized like the texture
+// sampler does. Return 0 if the image is compressed or of another type.
+//
+// Voxel v of level l is in cell min(v / (cellSize * 2^l), size of level l - 1), see
+// <ntoy/min_max.glsl>.
+osg::Image* createMinMaxPyramid(const osg::Image& volume, int cellSize);
+
+// Pyramid of a volume that isn't decoded yet, its bounds skip nothing.
+osg::Image* getMinMaxPlaceholder();
+
+// Name and source of shader include with helpers to read a pyramid.
+const char* getMinMaxIncludeName();
+const char* getMinMaxIncludeSource();
+
+}  // namespace ntoy
+
+#endif // NTOY_MINMAXPYRAMID_H
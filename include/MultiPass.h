@@ -0,0 +1,93 @@
+#ifndef NTOY_MULTIPASS_H
+#define NTOY_MULTIPASS_H
+
+#include <array>
+#include <functional>
+#include <string>
+
+#include <osg/Camera>
+#include <osg/Program>
+#include <osg/Texture2D>
+
+#include <FileWatcher.h>
+
+namespace ntoy
+{
+
+class BackgroundCompiler;
+class RenderTargetPool;
+class ShaderLibrary;
+
+// Shadertoy buffer A to D. Each buffer is a fragment pass drawn by a pre render camera
+// into a double buffered float texture, in order A to D before the scene. Every pass and
+// the scene read buffer X as sampler2D toy_BufferX on unit firstUnit + X: it's output of
+// this frame if X is drawn before the reader, output of last frame otherwise, so a pass
+// can read its own last frame.
+class MultiPass
+{
+public:
+    static const int numBuffers = 4;
+    // unit of buffer A, B to D follow it.
+    static const int firstUnit = 8;
+
+    MultiPass(ShaderLibrary& library, BackgroundCompiler& compiler, RenderTargetPool& pool);
+
+    // buffer is A, B, C or D. Return false if buffer is invalid or file can't be read.
+    bool addBuffer(const std::string& buffer, const std::string& file);
+
+    bool empty() const;
+
+    // Create pass cameras under parent, samplers and inputs of the scene are set on parent
+    // state set. Passes inherit state of parent, except program.
+    void setup(osg::Group* parent, const std::string& vertexSource, int width, int height);
+
+    // Targets are reallocated, content of buffers is lost.
+    void resize(int width, int height);
+
+    // Link passes that depend on any of files in background, a pass keeps drawing with its
+    // current program until the new one is linked.
+    void reload(const FileSet& files, const osg::StateSet* defines);
+
+    // Call it in update traversal, pick cameras and inputs of the frame.
+    void update(unsigned frameNumber);
+
+    // Called after a pass swaps in a relinked program.
+    const std::function<void()>& getSwapCallback() const { return _swapCallback; }
+    void setSwapCallback(const std::function<void()>& v) { _swapCallback = v; }
+
+private:
+    struct Pass
+    {
+        std::string file;
+        // source of the latest program, linked or not
+        std::string source;
+        osg::ref_ptr<osg::Program> program;
+        osg::ref_ptr<osg::Program> pendingProgram;
+        osg::ref_ptr<osg::Group> group;
+        // camera i draws into texture i on frames of parity i
+        osg::ref_ptr<osg::Camera> cameras[2];
+        osg::ref_ptr<osg::Texture2D> textures[2];
+    };
+
+    osg::Program* createProgram(const Pass& pass);
+
+    void allocateTargets();
+
+    void releaseTargets();
+
+    ShaderLibrary& _library;
+    BackgroundCompiler& _compiler;
+    RenderTargetPool& _pool;
+
+    int _width = 0;
+    int _height = 0;
+    osg::Group* _parent = 0;
+    osg::ref_ptr<osg::Shader> _vertex;
+    // pass without file is not used
+    std::array<Pass, numBuffers> _passes;
+    std::function<void()> _swapCallback;
+};
+
+}  // namespace ntoy
+
+#endif // NTOY_MULTIPASS_H
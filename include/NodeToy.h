@@ -1,13 +1,40 @@
 #ifndef NTOY_NODETOY_H
 #define NTOY_NODETOY_H
 
+#include <functional>
+#include <memory>
+#include <tuple>
+
+#include <osg/Image>
+#include <osg/Matrixd>
 #include <osg/Node>
 
+#include <Accumulator.h>
+#include <AsyncNodeReader.h>
+#include <BackgroundCompiler.h>
+#include <BrickedVolume.h>
+#include <DynamicResolution.h>
+#include <LateLatch.h>
+#include <MultiPass.h>
+#include <ProgramCache.h>
+#include <RenderTargetPool.h>
+#include <ShaderLibrary.h>
+#include <TextureExporter.h>
+#include <TextureLoader.h>
+#include <TexturePack.h>
+#include <ToyBuiltins.h>
+
 namespace osg
 {
 class AutoTransform;
+class Camera;
 }
 
+namespace osgText
+{
+class Text;
+}  // namespace osgText
+
 namespace osgViewer
 {
 class Viewer;
@@ -21,8 +48,16 @@ class ResourceObserver;
 class NodeToy
 {
 public:
+    // Ask viewer for a frame after delay seconds, called from any thread.
+    using WakeCallback = std::function<void(double delay)>;
+
     NodeToy(osg::ArgumentParser& args, osgViewer::Viewer* viewer);
 
+    // Read --brick-volume, write a bricked volume for --texture3d. Return false if it
+    // fails.
+    static bool brickVolume(osg::ArgumentParser& args);
+
+    // Read node on a worker thread, current node is kept until the new one is ready.
     void reloadNode(const std::string& file);
 
     void reportBound();
@@ -31,9 +66,39 @@ public:
 
     void toggleAxes();
 
-    void exportTextures();
+    // Show smoothed input to draw and input to present latency of late latched mouse.
+    void toggleLatencyOverlay();
+
+    // Switch to variant step away from the current one, wrap around. Only variants that
+    // are already linked are switched to.
+    void switchVariant(int step);
+
+    // Call it once per frame. Return true if all textures are exported.
+    bool exportTextures();
+
+    // Return true if shadertoy quad is accumulated, see Accumulator.
+    bool isAccumulating() const { return _accumulator.isEnabled(); }
+
+    // Return true if frames are needed without any input or time change: accumulation
+    // isn't converged, node read, textures export or screenshot isn't done.
+    bool needsFrame() const;
+
+    // Poll observed files and background compiles between frames, without a traversal.
+    void poll();
+
+    // Return true if initial node read, texture decodes on worker threads and bricks the
+    // volume shader touches are done.
+    bool isSceneReady() const;
 
-    void updateMouse(const osg::Vec2& mouse);
+    // Capture main camera once scene is ready. Call it once per frame, return true after
+    // the screenshot is written.
+    bool screenshot();
+
+    // Input is coalesced, it's written to shader once per frame, and again right before
+    // the shadertoy quad is drawn. eventTime is osgGA::GUIEventAdapter::getTime().
+    void updateMouse(const osg::Vec2& mouse, double eventTime);
+
+    void clickMouse(const osg::Vec2& mouse);
 
     void updateResolution(const osg::Vec2& resolution);
 
@@ -45,6 +110,13 @@ public:
 
     osg::Group* getRoot() { return _root; }
 
+    ResourceObserver* getObserver() { return _observer; }
+
+    // Needed if viewer only renders on demand, node read and pending file changes need
+    // frames to finish.
+    const WakeCallback& getWakeCallback() const { return _wakeCallback; }
+    void setWakeCallback(const WakeCallback& v) { _wakeCallback = v; }
+
     osg::Group* getSceneRoot() { return _sceneRoot; }
 
     osg::AutoTransform* getAxes() { return _axes; }
@@ -71,37 +143,106 @@ public:
     bool getExportTextures() const { return _exportTextures; }
     void setExportTextures(bool v) { _exportTextures = v; }
 
+    const std::string& getScreenshotFile() const { return _screenshotFile; }
+    void setScreenshotFile(const std::string& v) { _screenshotFile = v; }
+
 private:
     // _root
     //   _sceneRoot
     //   _axes
     void createScene();
 
+    // Swap in node finished by _nodeReader.
+    void updateNode();
+
+    // Write built-ins block and uniforms of this frame.
+    void updateBuiltins();
+
+    void updateLatencyOverlay();
+
+    // Restart accumulation if anything the shader reads changed since last frame.
+    void updateAccumulation();
+
+    // Adapt render scale, resolution and mouse follow it.
+    void updateDynamicResolution();
+
+    // Load bricks the volume shader touched.
+    void updateBrickedVolume();
+
+    // time, mouse, mouse click, resolution, program and view of this frame
+    using FrameInput =
+        std::tuple<double, osg::Vec2, osg::Vec2, osg::Vec2, osg::Program*, osg::Matrixd>;
+    FrameInput getFrameInput() const;
+
+    // Wake viewer when pending file changes settle.
+    void requestReloadFrame();
+
+    void readReloadOptions(osg::ArgumentParser& args);
+
     void readTextures(osg::ArgumentParser& args);
 
+    // Stream .bvol of --texture3d through _brickedVolume, throw std::runtime_error if it
+    // can't be opened.
+    void readBrickedVolume(
+        int unit, const std::string& file, double cacheMiB, const std::string& filter);
+
+    // Read --texture2d-pack images into _texturePack, before shaders include it.
+    void readTexturePack(osg::ArgumentParser& args);
+
     bool readShaders(osg::ArgumentParser& args);
 
     osg::Shader* readShader(
         osg::ArgumentParser& args, const std::string& option, int shaderType = -1);
 
+    // Create shader with source expanded by _shaderLibrary, add it to _program, observe
+    // file and everything it includes. Type is deduced from extension if shaderType is -1.
+    osg::Shader* createShader(const std::string& file, int shaderType = -1);
+
+    // Link a new program with updated source of shaders that depend on any of files, in
+    // background. Current program is kept until it's linked.
+    void reloadShaders(const FileSet& files);
+
+    void compileProgram(osg::Program* program);
+
+    // Replace _program with _pendingProgram.
+    void swapProgram();
+
+    void observeShaderFiles();
+
     void setupProgram();
 
+    // Use cached binary for _program, or record it after it's linked.
+    void applyProgramCache();
+
     void readDefines(osg::ArgumentParser& args);
 
+    // Build every combination of --variant defines, the first one is applied.
+    void readVariants(osg::ArgumentParser& args);
+
+    // Set or remove variant defines of stateSet.
+    void applyVariant(int index, osg::StateSet* stateSet);
+
+    // Link every variant except the current one from _program in background.
+    void compileVariants();
+
+    void compileVariant(int index);
+
     void createShadertoyNode();
 
-    void readNode(osg::ArgumentParser& args);
+    // Read --accumulate, draw shadertoy quad through _accumulator.
+    void readAccumulation(osg::ArgumentParser& args);
 
-    void readExportTextures(const std::string& script);
+    // Read --dynamic-resolution, draw shadertoy quad through _dynamicResolution.
+    void readDynamicResolution(osg::ArgumentParser& args);
 
-    struct ExportTexture
-    {
-        std::string output_name;
-        std::string frag;
-        osg::ref_ptr<osg::Image> img;
-    };
+    // Read --buffer passes of shadertoy.
+    void readBuffers(osg::ArgumentParser& args);
+
+    void readNode(osg::ArgumentParser& args);
+
+    void readExportTextures(osg::ArgumentParser& args, const std::string& script);
 
-    void addExportTexture(ExportTexture& et);
+    osg::Program* createExportProgram(const std::string& frag);
 
     bool _exportTextures = false;
     int _index = 0;
@@ -118,15 +259,57 @@ private:
     osg::Shader* _tese = 0;
     osg::Shader* _comp = 0;
     osg::Program* _program = 0;
+    ProgramCache _programCache;
+    BackgroundCompiler _compiler;
+    osg::ref_ptr<osg::Program> _pendingProgram;
+    // current shader : replacement in _pendingProgram
+    std::map<osg::Shader*, osg::Shader*> _pendingShaders;
+
+    struct Variant
+    {
+        std::string name;
+        // name : value of defined variant defines, undefined ones are absent
+        std::map<std::string, std::string> defines;
+        // shares shaders with _program, it is _program for the current variant
+        osg::ref_ptr<osg::Program> program;
+        bool linked = false;
+    };
+    std::vector<std::string> _variantDefines;
+    std::vector<Variant> _variants;
+    int _variantIndex = 0;
+
+    ShaderLibrary _shaderLibrary;
+    // file : shaders created from it
+    std::map<std::string, std::vector<osg::Shader*>> _shaders;
+    FileSet _observedShaderFiles;
+    RenderTargetPool _renderTargets;
+    MultiPass _multiPass{_shaderLibrary, _compiler, _renderTargets};
+    ToyBuiltins _builtins;
+    Accumulator _accumulator{_renderTargets};
+    FrameInput _accumulationInput;
+    DynamicResolution _dynamicResolution{_renderTargets};
+    LateLatch _lateLatch{_builtins};
+    osg::Camera* _latencyOverlay = 0;
+    osgText::Text* _latencyText = 0;
+    double _latencyTextTime = 0;
     osg::Uniform* _mouseUniform = 0;
     osg::Uniform* _resolutionUniform = 0;
 
     ResourceObserver* _observer = 0;
+    WakeCallback _wakeCallback;
 
     std::string _nodeFile;
+    AsyncNodeReader _nodeReader;
+    TextureLoader _textureLoader;
+    BrickedVolume _brickedVolume;
+    TexturePack _texturePack;
+    FrameInput _brickInput;
+
+    std::unique_ptr<TextureExporter> _textureExporter;
 
-    using ExportTextureList = std::vector<ExportTexture>;
-    ExportTextureList _exportTextureList;
+    bool _screenshotRequested = false;
+    std::string _screenshotFile;
+    osg::ref_ptr<osg::Image> _screenshotImage;
 };
 
 }  // namespace ntoy
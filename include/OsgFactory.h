@@ -214,7 +214,7 @@ osg::Program* createProgram(const std::string& vertFile, const std::string& frag
 osg::Program* createProgram(const std::string& vertFile, const std::string& geomFile,
     const std::string& fragFile, int inputType, int outputType, int maxVertices);
 
-// use file is shader source file is empty
+// use file is shader source file is empty. Shader is not touched if source is not changed.
 void reloadShader(osg::Shader& shader, const std::string& file = "");
 
 // Camera {{{1
@@ -232,6 +232,11 @@ osg::Camera* createFilterCamera(int x, int y, int width, int height);
 osg::Camera* createOrthoCamera(
     double left, double right, double bottom, double top, double near = -1, double far = 1);
 
+using CameraDrawFunc = std::function<void(osg::RenderInfo&)>;
+
+// Return osg::Camera::DrawCallback*
+void* createDrawCallback(CameraDrawFunc func);
+
 // Fbo {{{1
 
 // tex0 must not be empty
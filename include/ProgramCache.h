@@ -0,0 +1,89 @@
+#ifndef NTOY_PROGRAMCACHE_H
+#define NTOY_PROGRAMCACHE_H
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <osg/Program>
+
+namespace osg
+{
+class Drawable;
+class StateSet;
+}  // namespace osg
+
+namespace ntoy
+{
+
+// Cache linked program binaries in memory and on disk, keyed by hash of shader sources and
+// defines. A program seen before is restored with glProgramBinary instead of being
+// compiled and linked again. Binaries rejected by the driver are dropped, the program is
+// relinked from source in that case.
+class ProgramCache
+{
+public:
+    ProgramCache();
+
+    // Use binary of program if there is one, otherwise record it after program is linked.
+    // Call it whenever shader sources or defines changed.
+    void apply(osg::Program* program, const osg::StateSet* defines);
+
+    // Use binary of program if there is one, program is not recorded. Return true if
+    // binary is found.
+    bool restore(osg::Program* program, const osg::StateSet* defines);
+
+    // Drop binary of program that failed to link.
+    void reject(const osg::Program& program, const osg::StateSet* defines);
+
+    // Add it under node rendered with the applied program, it retrieves binary in draw
+    // traversal.
+    osg::Drawable* getRecorder() { return _recorder; }
+
+    // Call it in update traversal, store binary retrieved in draw traversal. Return false
+    // once if applied program failed to link from source.
+    bool update();
+
+    // Empty to disable disk cache.
+    const std::string& getDirectory() const { return _directory; }
+    void setDirectory(const std::string& v) { _directory = v; }
+
+    // NTOY_CACHE_DIR, $XDG_CACHE_HOME/ntoy or $HOME/.cache/ntoy
+    static std::string getDefaultDirectory();
+
+    static std::string computeKey(const osg::Program& program, const osg::StateSet* defines);
+
+    // Ask driver to keep binary of program for current defines of state, call it in
+    // graphics thread before program is linked. Some drivers keep none without it.
+    static void setRetrievableHint(const osg::Program& program, osg::State& state);
+
+private:
+    void record(osg::RenderInfo& renderInfo);
+
+    osg::ProgramBinary* find(const std::string& key);
+
+    void add(const std::string& key, osg::ProgramBinary* binary);
+
+    void remove(const std::string& key);
+
+    std::string getFileName(const std::string& key) const;
+
+    // members below are shared with draw traversal
+    bool _binaryApplied = false;
+    bool _binaryRejected = false;
+    bool _linkFailed = false;
+    bool _needRecord = false;
+    bool _hintRequested = false;
+    osg::ref_ptr<osg::Program> _program;
+    std::string _key;
+    osg::ref_ptr<osg::ProgramBinary> _recorded;
+    std::mutex _mutex;
+
+    std::string _directory;
+    osg::ref_ptr<osg::Drawable> _recorder;
+    std::map<std::string, osg::ref_ptr<osg::ProgramBinary>> _binaries;
+};
+
+}  // namespace ntoy
+
+#endif // NTOY_PROGRAMCACHE_H
@@ -0,0 +1,80 @@
+#ifndef NTOY_RENDERTARGETPOOL_H
+#define NTOY_RENDERTARGETPOOL_H
+
+#include <cstddef>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include <osg/Texture2D>
+#include <osg/ref_ptr>
+
+namespace ntoy
+{
+
+// Hand out render target textures, reuse released ones of the same size, format and sample
+// count instead of allocating new ones. Transient targets of a frame are aliased: targets
+// whose passes don't overlap share one texture. GPU memory of every texture owned by the
+// pool is estimated, peak included.
+class RenderTargetPool
+{
+public:
+    // Target used from firstPass to lastPass of a frame, passes are counted in draw order.
+    struct TransientTarget
+    {
+        int width = 0;
+        int height = 0;
+        GLenum internalFormat = GL_RGBA8;
+        int samples = 0;
+        int firstPass = 0;
+        int lastPass = 0;
+    };
+
+    // Linear filtered, clamped to edge. samples is what the camera attaches it with, the
+    // multisample renderbuffer is counted as memory of the texture.
+    osg::Texture2D* acquire(int width, int height, GLenum internalFormat, int samples = 0);
+
+    // Return texture of each target, targets of the same size, format and samples whose
+    // pass ranges don't overlap get the same texture.
+    std::vector<osg::ref_ptr<osg::Texture2D>> acquireTransient(
+        const std::vector<TransientTarget>& targets);
+
+    // Texture must come from acquire, it's given to the next acquire of the same size,
+    // format and samples.
+    void release(osg::Texture2D* texture);
+
+    // Release textures from acquireTransient, each shared texture is released once.
+    void releaseTransient(const std::vector<osg::ref_ptr<osg::Texture2D>>& textures);
+
+    // Drop released textures, GL objects are deleted once nothing else references them.
+    void trim();
+
+    // Textures acquired and not released.
+    unsigned getNumAcquired() const { return static_cast<unsigned>(_acquired.size()); }
+
+    // Acquired and released textures.
+    unsigned getNumTextures() const;
+
+    // Estimated GPU memory of acquired and released textures, in bytes.
+    std::size_t getBytes() const { return _bytes; }
+
+    std::size_t getPeakBytes() const { return _peakBytes; }
+
+    static std::size_t estimateBytes(
+        int width, int height, GLenum internalFormat, int samples = 0);
+
+private:
+    // width, height, internal format, samples
+    using Key = std::tuple<int, int, GLenum, int>;
+
+    static std::size_t estimateBytes(const Key& key);
+
+    std::map<Key, std::vector<osg::ref_ptr<osg::Texture2D>>> _freeTextures;
+    std::map<const osg::Texture2D*, Key> _acquired;
+    std::size_t _bytes = 0;
+    std::size_t _peakBytes = 0;
+};
+
+}  // namespace ntoy
+
+#endif // NTOY_RENDERTARGETPOOL_H
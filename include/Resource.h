@@ -2,16 +2,14 @@
 #define NTOY_RESOURCE_H
 
 #include <functional>
+#include <map>
 #include <stdexcept>
 #include <vector>
-#ifdef WIN32
-
-#else
-#    include <sys/stat.h>
-#endif
 
 #include <osg/Node>
 
+#include <FileWatcher.h>
+
 namespace ntoy
 {
 
@@ -22,8 +20,6 @@ public:
 
     Resource(const std::string& file, ModifiedCallback ModifiedCallback);
 
-    bool check();
-
     void invokeCallback();
 
     struct ResourceNotFoundError : public std::runtime_error
@@ -35,13 +31,6 @@ public:
     void setFile(const std::string& v) { _file = v; }
 
 private:
-
-#ifdef WIN32
-    time_t _mtime = 0;
-#else
-    timespec _mtime = {0, 0};
-#endif
-
     std::string _file;
     ModifiedCallback _callback;
 };
@@ -53,12 +42,33 @@ using ResourceList = std::vector<Resource>;
 class ResourceObserver : public osg::Callback
 {
 public:
+    // Called once per burst of changes, after callbacks of all changed resources.
+    using BatchCallback = std::function<void(const FileSet&)>;
+
+    ResourceObserver();
+
     bool run(osg::Object* object, osg::Object* data) override;
 
+    // Poll watcher, invoke callbacks of settled changes. run calls it in update traversal.
+    void poll();
+
     void addResource(const Resource& resource);
 
+    FileWatcher* getFileWatcher() { return _watcher; }
+
+    ChangeCoalescer& getCoalescer() { return _coalescer; }
+
+    const BatchCallback& getBatchCallback() const { return _batchCallback; }
+    void setBatchCallback(const BatchCallback& v) { _batchCallback = v; }
+
 private:
-    ResourceList _resources;
+    osg::ref_ptr<FileWatcher> _watcher;
+    ChangeCoalescer _coalescer;
+    BatchCallback _batchCallback;
+
+    // file : resources of that file. Each file is watched once.
+    std::map<std::string, ResourceList> _resources;
+    FileSet _changedFiles;
 };
 
 }  // namespace ntoy
@@ -0,0 +1,74 @@
+#ifndef NTOY_SHADERLIBRARY_H
+#define NTOY_SHADERLIBRARY_H
+
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <FileWatcher.h>
+
+namespace ntoy
+{
+
+struct ShaderIncludeError : public std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+// Expand #include "file" and #pragma include "file" in shader files. Expanded source of
+// every file is cached until the file, or anything it includes, is invalidated. Included
+// files are searched in directory of the including file, then in OSG_FILE_PATH. #pragma
+// once is turned into an include guard. #line directives keep line numbers of compile
+// errors, with a source string number per file. Files are never modified otherwise,
+// included files must not have #version.
+class ShaderLibrary
+{
+public:
+    // Throw ShaderIncludeError if file or anything it includes can't be read, or if
+    // includes form a cycle.
+    const std::string& getSource(const std::string& file);
+
+    // Drop cache of file and every file that includes it, directly or not. Insert all of
+    // them, file included, into invalidatedFiles.
+    void invalidate(const std::string& file, FileSet& invalidatedFiles);
+
+    // Every file that has been read, shader files and included files, and where missing
+    // includes were searched first.
+    const FileSet& getFiles() const { return _files; }
+
+    // Log file of every source string number, call it after a compile failed.
+    void logFileIndices() const;
+
+    // Source of an include that isn't a file, e.g. #include <ntoy/bricked_volume.glsl>.
+    // It's matched by name before any file, it's never invalidated.
+    void addBuiltin(const std::string& name, const std::string& source);
+
+private:
+    const std::string& expand(const std::string& file, std::vector<std::string>& stack);
+
+    // Source string number of file in #line, it never changes. 0 is left to the driver.
+    int getFileIndex(const std::string& file);
+
+    // Return empty string if include isn't found.
+    std::string resolveInclude(const std::string& file, const std::string& include) const;
+
+    FileSet _files;
+
+    // name : source of builtin includes
+    std::map<std::string, std::string> _builtins;
+    // file : expanded source
+    std::map<std::string, std::string> _sources;
+    // file : source string number
+    std::map<std::string, int> _fileIndices;
+    // file of source string number i + 1
+    std::vector<std::string> _indexedFiles;
+    // file : files it includes directly
+    std::map<std::string, FileSet> _includes;
+    // file : files that include it directly
+    std::map<std::string, FileSet> _includedBy;
+};
+
+}  // namespace ntoy
+
+#endif // NTOY_SHADERLIBRARY_H
@@ -1,7 +1,9 @@
 #ifndef NTOY_STRINGUTIL_H
 #define NTOY_STRINGUTIL_H
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace sutil
 {
@@ -10,6 +12,17 @@ std::string toupper(const std::string& s);
 
 std::string tolower(const std::string& s);
 
+// Empty pieces are kept, "a||b" is split into "a", "" and "b".
+std::vector<std::string> split(const std::string& s, char delimiter);
+
+// FNV-1a, pass previous result as h to hash data in pieces.
+std::uint64_t hash(
+    const char* data, std::size_t size, std::uint64_t h = 14695981039346656037ull);
+
+std::uint64_t hash(const std::string& s, std::uint64_t h = 14695981039346656037ull);
+
+std::string toHex(std::uint64_t v);
+
 }  // namespace sutil
 
 #endif // NTOY_STRINGUTIL_H
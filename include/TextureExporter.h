@@ -0,0 +1,102 @@
+#ifndef NTOY_TEXTUREEXPORTER_H
+#define NTOY_TEXTUREEXPORTER_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <osg/GL>
+#include <osg/ref_ptr>
+
+#include <RenderTargetPool.h>
+
+namespace osg
+{
+class Drawable;
+class Group;
+class Program;
+class RenderInfo;
+}  // namespace osg
+
+namespace ntoy
+{
+
+class ThreadPool;
+class TileWriter;
+
+// Render export textures in waves of rtt cameras. Each camera renders into a texture which
+// is read back into a pixel buffer object, the buffer is mapped a frame later so the
+// readback never stalls, then the image is encoded and written on a thread pool. Images
+// only live between mapping and writing, at most two waves of them. Cameras of a wave are
+// drawn one after another and a texture is done once it's read back, so items of the same
+// size and format share one texture, it's reused by later waves too. Items larger than the
+// tile size are rendered tile by tile, each tile is streamed into the output file by a
+// TileWriter, shaders get the tile offset in uniform tileOrigin.
+class TextureExporter
+{
+public:
+    struct Item
+    {
+        std::string outputName;
+        std::string frag;
+        int width = 0;
+        int height = 0;
+        GLenum pixelFormat = GL_RGBA;
+        GLenum pixelType = GL_UNSIGNED_BYTE;
+        int packing = 1;
+    };
+
+    using ProgramFactory = std::function<osg::Program*(const std::string& frag)>;
+
+    // Cameras are added under parent.
+    TextureExporter(osg::Group* parent, ProgramFactory programFactory);
+
+    ~TextureExporter();
+
+    void addItem(const Item& item);
+
+    // Call it once per frame in main thread. Return true if every item is written.
+    bool update();
+
+    // Number of cameras rendered in the same frame.
+    int getWaveSize() const { return _waveSize; }
+    void setWaveSize(int v) { _waveSize = v; }
+
+    // Max width and height of a tile, items larger than it are tiled.
+    int getTileSize() const { return _tileSize; }
+    void setTileSize(int v) { _tileSize = v; }
+
+private:
+    struct Job;
+
+    void startWave();
+
+    // Called in final draw callback of job camera.
+    void readback(osg::RenderInfo& renderInfo, Job& job);
+
+    // Map buffers read back in previous frames.
+    void collect(osg::RenderInfo& renderInfo);
+
+    int _waveSize = 8;
+    int _tileSize = 8192;
+    std::size_t _nextItem = 0;
+    // next tile of _nextItem, its program and writer are shared by all tiles.
+    int _nextTile = 0;
+    osg::ref_ptr<osg::Program> _tileProgram;
+    std::shared_ptr<TileWriter> _tileWriter;
+    osg::Group* _parent = 0;
+    osg::ref_ptr<osg::Drawable> _collector;
+    ProgramFactory _programFactory;
+    std::vector<Item> _items;
+    std::vector<std::shared_ptr<Job>> _jobs;
+    RenderTargetPool _targets;
+    std::vector<osg::ref_ptr<osg::Texture2D>> _waveTextures;
+    std::unique_ptr<ThreadPool> _pool;
+    std::mutex _mutex;
+};
+
+}  // namespace ntoy
+
+#endif // NTOY_TEXTUREEXPORTER_H
@@ -0,0 +1,126 @@
+#ifndef NTOY_TEXTURELOADER_H
+#define NTOY_TEXTURELOADER_H
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <osg/Drawable>
+#include <osg/Image>
+#include <osg/StateSet>
+#include <osg/Texture>
+#include <osg/Texture3D>
+#include <osg/ref_ptr>
+
+namespace ntoy
+{
+
+class ThreadPool;
+
+// Decode texture images on a thread pool. A texture gets a 1 pixel placeholder at once and
+// its image is swapped in by update once it's decoded, so nothing waits for the decode.
+// If min filter of the texture uses mipmaps, mipmaps of 8 bit and float images are box
+// filtered on the worker too. Image data is released once it's uploaded.
+//
+// A reloaded image is streamed into a new texture by the stream drawable, a few MiB per
+// frame through a ring of pixel buffer objects, so draw never waits for a whole image in
+// glTexImage. The old texture stays bound until the new one is complete.
+//
+// A 3d texture can also get a min max pyramid of its image for empty space skipping, it's
+// built on the worker and swapped in with the image.
+class TextureLoader
+{
+public:
+    TextureLoader();
+
+    // Finish queued decodes, then join.
+    ~TextureLoader();
+
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    // Bind texture to unit of stateSet, decode file for it. Texture keeps its current image
+    // if decode fails. If minMaxUnit isn't -1 and texture is 3d, bind min max pyramid of
+    // its image to minMaxUnit as sampler3D toy_MinMaxN, N is unit, with float
+    // toy_MinMaxCellN voxels per cell, see createMinMaxPyramid.
+    void load(osg::StateSet* stateSet, unsigned unit, osg::Texture* texture,
+        const std::string& file, int minMaxUnit = -1);
+
+    // Decode file again for every texture loaded from it, stream it into a replacement.
+    void reload(const std::string& file);
+
+    // Call it in update traversal, set decoded images, bind streamed textures. Return true
+    // if a placeholder was replaced by its decoded image or a streamed texture was bound.
+    bool update();
+
+    // Add it to the scene, it streams reloaded images in draw traversal.
+    osg::Drawable* getStreamDrawable() { return _streamDrawable; }
+
+    // Return true if nothing is being decoded or streamed.
+    bool isIdle() const;
+
+    // Voxels per side of a min max pyramid cell.
+    int getMinMaxCellSize() const { return _minMaxCellSize; }
+    void setMinMaxCellSize(int v) { _minMaxCellSize = v; }
+
+    // Bytes streamed per frame, at least one row is streamed.
+    std::size_t getStreamBudget() const { return _streamBudget; }
+    void setStreamBudget(std::size_t v) { _streamBudget = v; }
+
+    // Gray 1 pixel image, for 1d, 2d and 3d textures.
+    static osg::Image* getPlaceholder();
+
+private:
+    struct Slot
+    {
+        std::string file;
+        osg::ref_ptr<osg::StateSet> stateSet;
+        unsigned unit = 0;
+        osg::ref_ptr<osg::Texture> texture;
+        // a decoded image is set, later ones are streamed.
+        bool loaded = false;
+        int minMaxUnit = -1;
+        osg::ref_ptr<osg::Texture3D> minMax;
+    };
+
+    struct Decoded
+    {
+        osg::ref_ptr<osg::Image> image;
+        osg::ref_ptr<osg::Image> minMax;
+    };
+
+    struct Job
+    {
+        std::size_t slot = 0;
+        std::future<Decoded> decoded;
+    };
+
+    struct Upload;
+
+    void decode(std::size_t slot);
+
+    // Start streaming image into a copy of the slot texture, minMax is swapped in with it.
+    void startUpload(std::size_t slot, osg::Image* image, osg::Image* minMax);
+
+    // Called in draw traversal.
+    void stream(osg::RenderInfo& renderInfo);
+
+    int _minMaxCellSize = 8;
+    std::size_t _streamBudget = 16 << 20;
+    std::vector<Slot> _slots;
+    std::vector<Job> _jobs;
+    std::unique_ptr<ThreadPool> _pool;
+    osg::ref_ptr<osg::Drawable> _streamDrawable;
+
+    // following are accessed in draw thread.
+    mutable std::mutex _mutex;
+    std::vector<std::shared_ptr<Upload>> _uploads;
+    std::vector<GLuint> _pbos;
+    std::size_t _nextPbo = 0;
+};
+
+}  // namespace ntoy
+
+#endif // NTOY_TEXTURELOADER_H
@@ -0,0 +1,95 @@
+#ifndef NTOY_TEXTUREPACK_H
+#define NTOY_TEXTUREPACK_H
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <osg/Image>
+#include <osg/StateSet>
+#include <osg/Texture2DArray>
+#include <osg/Vec4>
+
+namespace ntoy
+{
+
+class ThreadPool;
+
+// Pack many small 2d images into one sampler2DArray, so a shader reads all of them through
+// one texture unit. Images of the same size and format become layers of their own, images
+// of mixed sizes are shelf packed into atlas layers with a 1 pixel border of their edge.
+// Layer and uv rect of every image are uniform arrays, include <ntoy/pack.glsl> for them,
+// TOY_PACK_NAME for index of image name.ext and toy_SamplePack to sample it.
+//
+// Images are decoded and packed on a thread pool, shader sees a gray placeholder until
+// then.
+class TexturePack
+{
+public:
+    static const char* getIncludeName();
+
+    TexturePack();
+
+    // Wait for queued packs.
+    ~TexturePack();
+
+    TexturePack(const TexturePack&) = delete;
+    TexturePack& operator=(const TexturePack&) = delete;
+
+    // Add image file, call it before setup.
+    void addFile(const std::string& file);
+
+    const std::vector<std::string>& getFiles() const { return _files; }
+
+    bool isEnabled() const { return !_files.empty(); }
+
+    // Source of <ntoy/pack.glsl>, it depends only on files.
+    std::string getIncludeSource() const;
+
+    // Bind pack to unit of stateSet, add lookup uniforms, start packing. Atlas layers have
+    // no mipmaps, a mipmap min filter falls back to linear for them.
+    void setup(osg::StateSet* stateSet, unsigned unit, osg::Texture::FilterMode minFilter,
+        osg::Texture::FilterMode magFilter);
+
+    // Pack every file again after current pack is done.
+    void reload() { _reloadRequested = true; }
+
+    // Call it in update traversal, swap in finished pack. Return true if it did.
+    bool update();
+
+    // Return true if nothing is being packed.
+    bool isIdle() const { return !_reloadRequested && !_job.valid(); }
+
+private:
+    struct Packed
+    {
+        // same size layers
+        std::vector<osg::ref_ptr<osg::Image>> layers;
+        // xy offset, zw size in uv of layer
+        std::vector<osg::Vec4> rects;
+        std::vector<float> layerIndices;
+        bool atlas = false;
+    };
+
+    static Packed pack(const std::vector<std::string>& files);
+
+    void start();
+
+    void bind(const Packed& packed);
+
+    std::vector<std::string> _files;
+    osg::ref_ptr<osg::StateSet> _stateSet;
+    unsigned _unit = 0;
+    osg::Texture::FilterMode _minFilter = osg::Texture::LINEAR;
+    osg::Texture::FilterMode _magFilter = osg::Texture::LINEAR;
+    osg::ref_ptr<osg::Uniform> _rectsUniform;
+    osg::ref_ptr<osg::Uniform> _layersUniform;
+    bool _reloadRequested = false;
+    std::future<Packed> _job;
+    std::unique_ptr<ThreadPool> _pool;
+};
+
+}  // namespace ntoy
+
+#endif // NTOY_TEXTUREPACK_H
@@ -0,0 +1,59 @@
+#ifndef NTOY_THREADPOOL_H
+#define NTOY_THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ntoy
+{
+
+// Fixed number of worker threads running queued jobs in FIFO order.
+class ThreadPool
+{
+public:
+    // 0 means std::thread::hardware_concurrency()
+    explicit ThreadPool(unsigned numThreads = 0);
+
+    // Finish queued jobs, then join.
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template<typename F>
+    auto submit(F func) -> std::future<decltype(func())>
+    {
+        using Result = decltype(func());
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(func));
+        auto future = task->get_future();
+        push([task]() { (*task)(); });
+        return future;
+    }
+
+    // Jobs queued or running.
+    unsigned getNumPendingJobs() const;
+
+    unsigned getNumThreads() const { return static_cast<unsigned>(_threads.size()); }
+
+private:
+    void push(std::function<void()> job);
+
+    void work();
+
+    bool _done = false;
+    unsigned _numRunningJobs = 0;
+    std::deque<std::function<void()>> _jobs;
+    std::vector<std::thread> _threads;
+    mutable std::mutex _mutex;
+    std::condition_variable _condition;
+};
+
+}  // namespace ntoy
+
+#endif // NTOY_THREADPOOL_H
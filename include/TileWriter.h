@@ -0,0 +1,61 @@
+#ifndef NTOY_TILEWRITER_H
+#define NTOY_TILEWRITER_H
+
+#include <atomic>
+#include <string>
+
+#include <osg/GL>
+#include <osg/Image>
+#include <osg/ref_ptr>
+
+namespace ntoy
+{
+
+// Write an image tile by tile. pfm, ppm, pgm and raw files are created at full size up
+// front and every tile is written straight to its rows, only the tile is in memory. Other
+// formats are assembled in memory and written by osgDB after the last tile. Tiles are
+// rows of pixels bottom up, as read back from GL. writeTile can be called from several
+// threads, for different tiles.
+class TileWriter
+{
+public:
+    // Throw std::runtime_error if file can't be created.
+    TileWriter(const std::string& file, int width, int height, GLenum pixelFormat,
+        GLenum pixelType, int numTiles);
+
+    // Return true if the tile or, for the last tile, the whole file is written.
+    bool writeTile(int x, int y, const osg::Image& tile);
+
+    // Return true if pixels of pixelFormat and pixelType can be streamed into file.
+    static bool canStream(const std::string& file, GLenum pixelFormat, GLenum pixelType);
+
+    const std::string& getFile() const { return _file; }
+
+private:
+    enum Format
+    {
+        PFM,
+        PNM,
+        RAW,
+        // assembled in memory
+        OTHER
+    };
+
+    bool streamTile(int x, int y, const osg::Image& tile);
+
+    bool copyTile(int x, int y, const osg::Image& tile);
+
+    std::string _file;
+    int _width = 0;
+    int _height = 0;
+    Format _format = OTHER;
+    // bytes of a pixel and header in file
+    std::size_t _pixelSize = 0;
+    std::size_t _headerSize = 0;
+    osg::ref_ptr<osg::Image> _image;
+    std::atomic<int> _remainingTiles;
+};
+
+}  // namespace ntoy
+
+#endif // NTOY_TILEWRITER_H
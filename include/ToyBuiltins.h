@@ -0,0 +1,94 @@
+#ifndef NTOY_TOYBUILTINS_H
+#define NTOY_TOYBUILTINS_H
+
+#include <cstdint>
+
+#include <osg/Array>
+#include <osg/BufferIndexBinding>
+#include <osg/Vec2>
+#include <osg/Vec3>
+
+namespace osg
+{
+class FrameStamp;
+class Program;
+class State;
+}  // namespace osg
+
+namespace ntoy
+{
+
+// Shadertoy built-ins packed in one std140 uniform block. The block is written once per
+// frame in update traversal and bound once at scene root, so a program that reads it
+// doesn't cost any glUniform call per frame. Input set between two updates is coalesced,
+// only the latest value is written.
+class ToyBuiltins
+{
+public:
+    // Uniform block binding index.
+    static const unsigned binding = 0;
+
+    // GLSL declaration of the block, it needs #version 140.
+    static const char* getBlockSource();
+
+    // Bind block of program to binding when it's linked.
+    static void bindProgram(osg::Program& program);
+
+    ToyBuiltins();
+
+    // Set it on the state set that uses the block.
+    osg::StateAttribute* getBinding();
+
+    const osg::Vec2& getMouse() const { return _mouse; }
+    void setMouse(const osg::Vec2& v) { _mouse = v; }
+
+    // Where mouse button was pushed last time.
+    const osg::Vec2& getMouseClick() const { return _mouseClick; }
+    void setMouseClick(const osg::Vec2& v) { _mouseClick = v; }
+
+    // Window coordinates of mouse are multiplied by it when they are written, it's the
+    // scale of the render target to the window.
+    float getMouseScale() const { return _mouseScale; }
+    void setMouseScale(float v) { _mouseScale = v; }
+
+    const osg::Vec2& getResolution() const { return _resolution; }
+    void setResolution(const osg::Vec2& v) { _resolution = v; }
+
+    // Size of texture at unit channel, channel must be less than 4.
+    void setChannelResolution(unsigned channel, const osg::Vec3& resolution);
+
+    // Write block for frameStamp.
+    void update(const osg::FrameStamp& frameStamp);
+
+    // Overwrite pointer of uploaded block in draw traversal, the rest of the block is
+    // untouched. Nothing happens if block is not uploaded yet.
+    void latchMouse(osg::State& state, const osg::Vec2& mouse);
+
+private:
+    // std140 layout of the block
+    struct Block
+    {
+        float resolution[4];
+        float mouse[4];
+        float date[4];
+        float channelResolution[4][4];
+        float time;
+        float timeDelta;
+        std::int32_t frame;
+        float frameRate;
+    };
+
+    osg::Vec2 _mouse;
+    osg::Vec2 _mouseClick;
+    float _mouseScale = 1;
+    osg::Vec2 _resolution;
+    osg::Vec3 _channelResolutions[4];
+    double _lastTime = -1;
+
+    osg::ref_ptr<osg::UByteArray> _data;
+    osg::ref_ptr<osg::UniformBufferBinding> _binding;
+};
+
+}  // namespace ntoy
+
+#endif // NTOY_TOYBUILTINS_H
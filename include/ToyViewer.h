@@ -1,16 +1,82 @@
 #ifndef WHACKAMOLE_TOYVIEWER_H
 #define WHACKAMOLE_TOYVIEWER_H
 
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include <osgViewer/Viewer>
 
+#include <FramePacer.h>
+#include <FrameProfiler.h>
+
 namespace toy
 {
 
+struct BenchSettings
+{
+    // Frames rendered before ready returns true are not counted as warm up frames.
+    int warmupFrames = 0;
+    int measuredFrames = 0;
+    double dt = 1.0 / 60.0;
+    double tolerance = 5.0;
+    std::string baselineFile;
+    std::string saveFile;
+    std::function<bool()> ready;
+};
+
 class ToyViewer : public osgViewer::Viewer
 {
 public:
+    // Return true if scene needs a frame for anything other than input, camera or time.
+    using NeedFrameCallback = std::function<bool()>;
+
+    using PollCallback = std::function<void()>;
+
+    // Stop threads before profiler is gone.
+    ~ToyViewer() override;
+
+    // Run benchmark instead if bench has measured frames. In ON_DEMAND frame scheme, it
+    // sleeps until input arrives or the frame pacer is woken. A wake without input calls
+    // poll callback only, it's rendered if checkNeedToDoFrame is true after that.
     int run() override;
 
+    // Frame if simulation time moves, input arrived, camera moved, redraw or continuous
+    // update is requested, or need frame callback returns true. Unlike osgViewer, update
+    // and event callbacks of the scene don't need a frame, so a paused unchanged scene is
+    // neither drawn nor swapped in ON_DEMAND scheme.
+    bool checkNeedToDoFrame() override;
+
+    const NeedFrameCallback& getNeedFrameCallback() const { return _needFrameCallback; }
+    void setNeedFrameCallback(const NeedFrameCallback& v) { _needFrameCallback = v; }
+
+    // Poll whatever can wake the viewer besides input, outside of any traversal. Request a
+    // redraw or make need frame callback return true if anything changed.
+    const PollCallback& getPollCallback() const { return _pollCallback; }
+    void setPollCallback(const PollCallback& v) { _pollCallback = v; }
+
+    // Add descriptors of observed files or wake it to render a frame in ON_DEMAND scheme.
+    FramePacer& getFramePacer() { return _pacer; }
+
+    // Profile every frame until run returns, see FrameProfiler. Return false if file can't
+    // be opened.
+    bool startProfiler(const std::string& file);
+
+    FrameProfiler* getProfiler() { return _profiler.get(); }
+
+    // Render into a pbuffer instead of a window, call it before realize. Return false if
+    // pbuffer can't be created.
+    bool setUpHeadless(int width, int height);
+
+    bool getHeadless() const { return _headless; }
+
+    // Render with fixed time step, vsync off, finish gpu work every frame, report min,
+    // median and p99 frame time. run returns 2 if median or p99 exceeds baseline by more
+    // than tolerance percent.
+    const BenchSettings& getBench() const { return _bench; }
+    void setBench(const BenchSettings& v) { _bench = v; }
+
     bool getPause() const { return _pause; }
     void setPause(bool v) { _pause = v; }
 
@@ -18,8 +84,22 @@ public:
     void setDebugSteps(int v) { _debugSteps = v; }
 
 private:
+    // Wake pacer on window events.
+    void addInputFileDescriptors();
+
+    int runBench();
+
+    // Return exit code of bench.
+    int reportBench(const std::vector<double>& frameTimes);
+
     int _debugSteps = 0;
     bool _pause = false;
+    bool _headless = false;
+    std::unique_ptr<FrameProfiler> _profiler;
+    BenchSettings _bench;
+    FramePacer _pacer;
+    NeedFrameCallback _needFrameCallback;
+    PollCallback _pollCallback;
 };
 
 class ViewerDebugHandler : public osgGA::GUIEventHandler
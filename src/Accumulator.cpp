@@ -0,0 +1,133 @@
+#include <Accumulator.h>
+
+#include <algorithm>
+
+#include <osg/BlendFunc>
+#include <osg/Program>
+
+#include <OsgFactory.h>
+#include <RenderTargetPool.h>
+
+namespace ntoy
+{
+
+namespace
+{
+
+auto displayFragSource = R"0(#version 120
+
+uniform sampler2D toy_Accumulation;
+uniform vec2 resolution;
+
+void main( void )
+{
+    gl_FragColor = texture2D(toy_Accumulation, gl_FragCoord.xy / resolution);
+})0";
+
+}  // namespace
+
+Accumulator::Accumulator(RenderTargetPool& pool) : _pool(pool) {}
+
+void Accumulator::setup(osg::Group* parent, osg::Node* scene,
+    const std::string& vertexSource, int width, int height)
+{
+    _parent = parent;
+    _width = width;
+    _height = height;
+
+    // mean = mean * (1 - w) + sample * w, the first sample overwrites, nothing to clear.
+    _blendColor = new osg::BlendColor;
+    _scissor = new osg::Scissor;
+    _sampleUniform = new osg::Uniform("toy_SampleIndex", 0);
+
+    _camera = osgf::createRttCamera(0, 0, width, height, osg::Camera::FRAME_BUFFER_OBJECT);
+    _camera->setName("Accumulation");
+    _camera->setRenderOrder(osg::Camera::PRE_RENDER, renderOrder);
+    _camera->setImplicitBufferAttachmentMask(0, 0);
+    auto ss = _camera->getOrCreateStateSet();
+    ss->setDataVariance(osg::Object::DYNAMIC);
+    ss->setAttributeAndModes(
+        new osg::BlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA));
+    ss->setAttribute(_blendColor);
+    ss->setAttributeAndModes(_scissor);
+    ss->addUniform(_sampleUniform);
+    _camera->addChild(scene);
+    parent->addChild(_camera);
+
+    auto program = new osg::Program;
+    program->addShader(new osg::Shader(osg::Shader::VERTEX, vertexSource));
+    program->addShader(new osg::Shader(osg::Shader::FRAGMENT, displayFragSource));
+
+    _display = new osg::Group;
+    _display->setName("AccumulationDisplay");
+    ss = _display->getOrCreateStateSet();
+    ss->setDataVariance(osg::Object::DYNAMIC);
+    ss->setAttributeAndModes(program);
+    ss->addUniform(new osg::Uniform("toy_Accumulation", 0));
+    _display->addChild(osgf::getNdcQuad());
+    parent->addChild(_display);
+
+    allocateTarget();
+    reset();
+}
+
+void Accumulator::resize(int width, int height)
+{
+    if (!_parent || (width == _width && height == _height))
+    {
+        return;
+    }
+
+    _width = width;
+    _height = height;
+    _pool.release(_texture);
+    _pool.trim();
+    allocateTarget();
+    reset();
+}
+
+void Accumulator::reset()
+{
+    _sampleIndex = 0;
+    _band = 0;
+}
+
+void Accumulator::update()
+{
+    if (!_parent)
+    {
+        return;
+    }
+
+    // converged, keep showing the mean.
+    if (isConverged())
+    {
+        _camera->setNodeMask(0);
+        return;
+    }
+    _camera->setNodeMask(~0u);
+
+    auto numBands = std::max(1, std::min(_numBands, _height));
+    auto y0 = _height * _band / numBands;
+    auto y1 = _height * (_band + 1) / numBands;
+    _scissor->setScissor(0, y0, _width, y1 - y0);
+    _blendColor->setConstantColor(osg::Vec4(1, 1, 1, 1.0f / (_sampleIndex + 1)));
+    _sampleUniform->set(_sampleIndex);
+
+    if (++_band >= numBands)
+    {
+        _band = 0;
+        ++_sampleIndex;
+    }
+}
+
+void Accumulator::allocateTarget()
+{
+    _texture = _pool.acquire(_width, _height, GL_RGBA32F_ARB);
+    _camera->setViewport(0, 0, _width, _height);
+    _camera->attach(osg::Camera::COLOR_BUFFER0, _texture);
+    _camera->dirtyAttachmentMap();
+    _display->getStateSet()->setTextureAttribute(0, _texture);
+}
+
+}  // namespace ntoy
@@ -0,0 +1,102 @@
+#include <AsyncNodeReader.h>
+
+#include <osg/Notify>
+#include <osgDB/ReadFile>
+
+namespace ntoy
+{
+
+AsyncNodeReader::AsyncNodeReader() : _thread(&AsyncNodeReader::work, this) {}
+
+AsyncNodeReader::~AsyncNodeReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _done = true;
+    }
+    _condition.notify_one();
+    _thread.join();
+}
+
+void AsyncNodeReader::request(const std::string& file)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_hasRequest)
+        {
+            OSG_INFO << "Drop superseded read of " << _requestFile << std::endl;
+        }
+        _requestFile = file;
+        _hasRequest = true;
+        _hasResult = false;
+        ++_requestId;
+    }
+    _condition.notify_one();
+}
+
+bool AsyncNodeReader::takeResult(std::string& file, osg::ref_ptr<osg::Node>& node)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_hasResult)
+    {
+        return false;
+    }
+
+    file = _resultFile;
+    node = _result;
+    _result = 0;
+    _hasResult = false;
+    return true;
+}
+
+void AsyncNodeReader::setFinishedCallback(std::function<void()> v)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _finishedCallback = v;
+}
+
+bool AsyncNodeReader::isIdle() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return !_hasRequest && !_hasResult && _finishedId == _requestId;
+}
+
+void AsyncNodeReader::work()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _condition.wait(lock, [this] { return _done || _hasRequest; });
+        if (_done)
+        {
+            return;
+        }
+
+        auto file = _requestFile;
+        auto id = _requestId;
+        _hasRequest = false;
+
+        lock.unlock();
+        OSG_NOTICE << "Reading " << file << std::endl;
+        osg::ref_ptr<osg::Node> node = osgDB::readNodeFile(file);
+        lock.lock();
+        _finishedId = id;
+
+        if (id != _requestId)
+        {
+            OSG_INFO << "Discard superseded read of " << file << std::endl;
+            continue;
+        }
+
+        _resultFile = file;
+        _result = node;
+        _hasResult = true;
+
+        if (_finishedCallback)
+        {
+            _finishedCallback();
+        }
+    }
+}
+
+}  // namespace ntoy
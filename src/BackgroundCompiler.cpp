@@ -0,0 +1,206 @@
+#include <BackgroundCompiler.h>
+
+#include <atomic>
+
+#include <osg/Drawable>
+#include <osg/GLExtensions>
+#include <osg/GraphicsContext>
+#include <osg/GraphicsThread>
+#include <osg/Program>
+#include <osg/State>
+#include <osg/StateSet>
+
+#include <OsgFactory.h>
+#include <ProgramCache.h>
+
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#    define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+
+namespace ntoy
+{
+
+struct BackgroundCompiler::Job
+{
+    osg::ref_ptr<osg::Program> program;
+    osg::ref_ptr<osg::StateSet> stateSet;
+    Callback callback;
+    std::atomic<bool> done{false};
+    bool linked = false;
+};
+
+namespace
+{
+
+void link(osg::State& state, BackgroundCompiler::Job& job)
+{
+    // defines decide which per context program is linked, hint it before apply links it.
+    state.pushStateSet(job.stateSet.get());
+    ProgramCache::setRetrievableHint(*job.program, state);
+    state.popStateSet();
+    state.apply(job.stateSet.get());
+    auto pcp = job.program->getPCP(state);
+    job.linked = pcp && pcp->isLinked();
+    job.done = true;
+}
+
+class LinkOperation : public osg::GraphicsOperation
+{
+public:
+    LinkOperation(std::shared_ptr<BackgroundCompiler::Job> job)
+        : osg::GraphicsOperation("LinkProgram", false), _job(job)
+    {
+    }
+
+    void operator()(osg::GraphicsContext* gc) override
+    {
+        link(*gc->getState(), *_job);
+        gc->getState()->reset();
+    }
+
+private:
+    std::shared_ptr<BackgroundCompiler::Job> _job;
+};
+
+// Let driver compile with as many threads as it likes.
+class ParallelCompileOperation : public osg::GraphicsOperation
+{
+public:
+    ParallelCompileOperation() : osg::GraphicsOperation("ParallelCompile", false) {}
+
+    void operator()(osg::GraphicsContext* gc) override
+    {
+        auto contextID = gc->getState()->getContextID();
+        if (!osg::isGLExtensionSupported(contextID, "GL_KHR_parallel_shader_compile") &&
+            !osg::isGLExtensionSupported(contextID, "GL_ARB_parallel_shader_compile"))
+        {
+            return;
+        }
+
+        using MaxShaderCompilerThreadsProc = void(GL_APIENTRY*)(GLuint);
+        MaxShaderCompilerThreadsProc maxShaderCompilerThreads = 0;
+        if (osg::setGLExtensionFuncPtr(maxShaderCompilerThreads,
+                "glMaxShaderCompilerThreadsKHR", "glMaxShaderCompilerThreadsARB"))
+        {
+            maxShaderCompilerThreads(0xFFFFFFFF);
+            OSG_INFO << "Enable parallel shader compile." << std::endl;
+        }
+    }
+};
+
+}  // namespace
+
+BackgroundCompiler::BackgroundCompiler()
+{
+    _fallbackCompiler = osgf::createDrawable(
+        [this](osg::RenderInfo& renderInfo, const osg::Drawable*) {
+            compileInDraw(*renderInfo.getState());
+        });
+    _fallbackCompiler->setName("FallbackCompiler");
+    _fallbackCompiler->setUseDisplayList(false);
+    _fallbackCompiler->setCullingActive(false);
+}
+
+BackgroundCompiler::~BackgroundCompiler()
+{
+    if (_compileContext)
+    {
+        if (_compileContext->getGraphicsThread())
+        {
+            _compileContext->getGraphicsThread()->cancel();
+        }
+        _compileContext->close();
+        osg::GraphicsContext::setCompileContext(_contextID, 0);
+    }
+}
+
+void BackgroundCompiler::setGraphicsContext(osg::GraphicsContext* gc)
+{
+    _contextID = gc->getState()->getContextID();
+    _compileContext = osg::GraphicsContext::getOrCreateCompileContext(_contextID);
+    if (!_compileContext)
+    {
+        OSG_NOTICE << "Failed to create compile context, programs are linked in draw."
+                   << std::endl;
+        return;
+    }
+
+    if (!_compileContext->getGraphicsThread())
+    {
+        _compileContext->createGraphicsThread();
+        _compileContext->getGraphicsThread()->startThread();
+    }
+    _compileContext->add(new ParallelCompileOperation);
+}
+
+void BackgroundCompiler::compile(
+    osg::Program* program, const osg::StateSet* stateSet, Callback callback)
+{
+    auto job = std::make_shared<Job>();
+    job->program = program;
+    job->callback = callback;
+
+    // only program and defines matter
+    job->stateSet = new osg::StateSet;
+    if (stateSet)
+    {
+        job->stateSet->setDefineList(stateSet->getDefineList());
+    }
+    job->stateSet->setAttributeAndModes(program);
+
+    _jobs.push_back(job);
+    if (_compileContext)
+    {
+        _compileContext->add(new LinkOperation(job));
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _drawJobs.push_back(job);
+    }
+}
+
+void BackgroundCompiler::update()
+{
+    // callback might compile again.
+    std::vector<std::shared_ptr<Job>> doneJobs;
+    for (auto iter = _jobs.begin(); iter != _jobs.end();)
+    {
+        if ((*iter)->done)
+        {
+            doneJobs.push_back(*iter);
+            iter = _jobs.erase(iter);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+
+    for (auto& job: doneJobs)
+    {
+        job->callback(job->program.get(), job->linked);
+    }
+}
+
+void BackgroundCompiler::compileInDraw(osg::State& state)
+{
+    std::vector<std::shared_ptr<Job>> jobs;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        jobs.swap(_drawJobs);
+    }
+
+    for (auto& job: jobs)
+    {
+        link(state, *job);
+    }
+
+    // restore state of render graph
+    if (!jobs.empty())
+    {
+        state.apply();
+    }
+}
+
+}  // namespace ntoy
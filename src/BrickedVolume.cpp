@@ -0,0 +1,671 @@
+#include <BrickedVolume.h>
+
+#ifdef WIN32
+
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <osg/BindImageTexture>
+#include <osg/GLExtensions>
+#include <osg/Math>
+#include <osg/Notify>
+
+#include <OsgFactory.h>
+#include <ThreadPool.h>
+
+#ifndef GL_R8
+#    define GL_R8 0x8229
+#    define GL_R16 0x822A
+#    define GL_RG8 0x822B
+#    define GL_RG16 0x822C
+#    define GL_R32F 0x822E
+#    define GL_RG32F 0x8230
+#endif
+#ifndef GL_R8UI
+#    define GL_R8UI 0x8232
+#endif
+#ifndef GL_RED_INTEGER
+#    define GL_RED_INTEGER 0x8D94
+#endif
+#ifndef GL_PIXEL_BUFFER_BARRIER_BIT
+#    define GL_PIXEL_BUFFER_BARRIER_BIT 0x00000080
+#    define GL_TEXTURE_UPDATE_BARRIER_BIT 0x00000100
+#endif
+
+namespace ntoy
+{
+
+// Read only mapping of a whole file.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& file)
+    {
+#ifdef WIN32
+        throw std::runtime_error("memory mapped " + file + " isn't supported on windows");
+#else
+        auto fd = ::open(file.c_str(), O_RDONLY);
+        if (fd == -1)
+        {
+            throw std::runtime_error(
+                "failed to open " + file + ": " + std::strerror(errno));
+        }
+
+        struct stat statbuf;
+        if (fstat(fd, &statbuf) != 0 || statbuf.st_size == 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("failed to stat " + file + " or it's empty");
+        }
+        _size = statbuf.st_size;
+
+        auto data = mmap(0, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+        {
+            throw std::runtime_error("failed to map " + file + ": " + std::strerror(errno));
+        }
+        _data = static_cast<const unsigned char*>(data);
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifndef WIN32
+        munmap(const_cast<unsigned char*>(_data), _size);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Pages are faulted in as they're touched, in no particular order.
+    void adviseRandom()
+    {
+#ifndef WIN32
+        madvise(const_cast<unsigned char*>(_data), _size, MADV_RANDOM);
+#endif
+    }
+
+    const unsigned char* data() const { return _data; }
+
+    std::size_t size() const { return _size; }
+
+private:
+    const unsigned char* _data = 0;
+    std::size_t _size = 0;
+};
+
+namespace
+{
+
+auto includeSource = R"0(#pragma once
+// Bricked volume of --texture3d name.bvol, it needs #version 420.
+uniform sampler3D toy_BrickAtlas;
+uniform sampler3D toy_BrickPageTable;
+layout(r8ui) uniform writeonly uimage3D toy_BrickFeedback;
+uniform vec3 toy_BrickVolumeSize;  // voxels
+uniform vec3 toy_BrickAtlasSize;   // texels
+uniform vec2 toy_BrickSize;        // voxels of a brick, texels of a stored brick
+
+// Sample volume at p in [0, 1]. A brick that isn't resident yet reads as 0.
+vec4 toy_SampleVolume(vec3 p)
+{
+    vec3 voxel = clamp(p, 0.0, 1.0) * toy_BrickVolumeSize;
+    vec3 grid = ceil(toy_BrickVolumeSize / toy_BrickSize.x);
+    vec3 brick = min(floor(voxel / toy_BrickSize.x), grid - 1.0);
+    imageStore(toy_BrickFeedback, ivec3(brick), uvec4(1));
+
+    vec4 page = texelFetch(toy_BrickPageTable, ivec3(brick), 0);
+    if (page.a < 0.5)
+    {
+        return vec4(0.0);
+    }
+
+    // page holds slot of the brick in atlas, there's a border around the brick.
+    vec3 slot = floor(page.xyz * 255.0 + 0.5);
+    vec3 texel = slot * toy_BrickSize.y + (toy_BrickSize.y - toy_BrickSize.x) * 0.5 +
+                 voxel - brick * toy_BrickSize.x;
+    return texture(toy_BrickAtlas, texel / toy_BrickAtlasSize);
+}
+)0";
+
+// Native endian. Bricks follow at dataAlignment, x of brick grid varies fastest, then y,
+// then z. Voxels of a brick are ordered the same way.
+struct Header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t size[3];
+    std::uint32_t brickSize;
+    std::uint32_t border;
+    std::uint32_t pixelFormat;
+    std::uint32_t dataType;
+};
+
+const char magic[8] = {'N', 'T', 'O', 'Y', 'B', 'V', 'O', 'L'};
+const std::uint32_t version = 1;
+const std::size_t dataAlignment = 4096;
+const int border = 1;
+
+// An atlas side must fit in 2048 texels, the minimum GL_MAX_3D_TEXTURE_SIZE of gl 3, and
+// in 255 slots, the range of a page table texel.
+const int maxAtlasSize = 2048;
+const int maxAtlasSlots = 255;
+
+// Feedbacks in a row that must miss nothing before the volume is idle, the latest frames
+// are still in flight when a feedback is handled.
+const int quietFeedbacks = 3;
+
+GLenum getInternalFormat(GLenum pixelFormat, GLenum dataType)
+{
+    static const GLenum ub[] = {GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+    static const GLenum us[] = {GL_R16, GL_RG16, GL_RGB16, GL_RGBA16};
+    static const GLenum f[] = {GL_R32F, GL_RG32F, GL_RGB32F_ARB, GL_RGBA32F_ARB};
+
+    auto components = osg::Image::computeNumComponents(pixelFormat);
+    if (components < 1 || components > 4)
+    {
+        return 0;
+    }
+
+    switch (dataType)
+    {
+        case GL_UNSIGNED_BYTE:
+            return ub[components - 1];
+        case GL_UNSIGNED_SHORT:
+            return us[components - 1];
+        case GL_FLOAT:
+            return f[components - 1];
+        default:
+            return 0;
+    }
+}
+
+osg::Vec3i getGrid(const osg::Vec3i& size, int brickSize)
+{
+    return osg::Vec3i((size.x() + brickSize - 1) / brickSize,
+        (size.y() + brickSize - 1) / brickSize, (size.z() + brickSize - 1) / brickSize);
+}
+
+}  // namespace
+
+const char* BrickedVolume::getIncludeName()
+{
+    return "ntoy/bricked_volume.glsl";
+}
+
+const char* BrickedVolume::getIncludeSource()
+{
+    return includeSource;
+}
+
+BrickedVolume::BrickedVolume() = default;
+
+BrickedVolume::~BrickedVolume() = default;
+
+void BrickedVolume::open(const std::string& file, std::size_t cacheBytes)
+{
+    _file.reset(new MappedFile(file));
+    _fileName = file;
+
+    Header header;
+    if (_file->size() < dataAlignment ||
+        (std::memcpy(&header, _file->data(), sizeof(header)),
+            std::memcmp(header.magic, magic, sizeof(magic)) != 0) ||
+        header.version != version || header.brickSize == 0)
+    {
+        throw std::runtime_error(file + " isn't a bricked volume");
+    }
+
+    _size = osg::Vec3i(header.size[0], header.size[1], header.size[2]);
+    _brickSize = header.brickSize;
+    _storedSize = _brickSize + header.border * 2;
+    _pixelFormat = header.pixelFormat;
+    _dataType = header.dataType;
+    _grid = getGrid(_size, _brickSize);
+    _brickBytes = osg::Image::computeImageSizeInBytes(
+        _storedSize, _storedSize, _storedSize, _pixelFormat, _dataType, 1);
+    _dataOffset = dataAlignment;
+
+    auto internalFormat = getInternalFormat(_pixelFormat, _dataType);
+    auto numBricks = _grid.x() * _grid.y() * _grid.z();
+    if (internalFormat == 0 ||
+        _file->size() < _dataOffset + numBricks * _brickBytes)
+    {
+        throw std::runtime_error(file + " is truncated or has unsupported pixel format");
+    }
+    _file->adviseRandom();
+
+    auto maxSlots = std::min(maxAtlasSlots, maxAtlasSize / _storedSize);
+    auto numSlots = static_cast<int>(std::min<std::size_t>(
+        std::max<std::size_t>(1, cacheBytes / _brickBytes), numBricks));
+    auto side = std::min(maxSlots, static_cast<int>(std::ceil(std::cbrt(numSlots))));
+    _atlasSlots.x() = side;
+    _atlasSlots.y() = std::min(side, (numSlots + side - 1) / side);
+    _atlasSlots.z() = std::min(maxSlots, std::max(1, numSlots / (side * _atlasSlots.y())));
+    numSlots = _atlasSlots.x() * _atlasSlots.y() * _atlasSlots.z();
+
+    _atlas = new osg::Texture3D;
+    _atlas->setTextureSize(_atlasSlots.x() * _storedSize, _atlasSlots.y() * _storedSize,
+        _atlasSlots.z() * _storedSize);
+    _atlas->setInternalFormat(internalFormat);
+    _atlas->setSourceFormat(_pixelFormat);
+    _atlas->setSourceType(_dataType);
+    _atlas->setResizeNonPowerOfTwoHint(false);
+    _atlas->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    _atlas->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+    _atlas->setWrap(osg::Texture::WRAP_R, osg::Texture::CLAMP_TO_EDGE);
+
+    // rgb is slot, a is 1 if resident.
+    _pageImage = new osg::Image;
+    _pageImage->setDataVariance(osg::Object::DYNAMIC);
+    _pageImage->allocateImage(
+        _grid.x(), _grid.y(), _grid.z(), GL_RGBA, GL_UNSIGNED_BYTE, 1);
+    _pageImage->setInternalTextureFormat(GL_RGBA8);
+    std::memset(_pageImage->data(), 0, _pageImage->getTotalSizeInBytes());
+
+    _pageTable = new osg::Texture3D(_pageImage);
+    _pageTable->setDataVariance(osg::Object::DYNAMIC);
+    _pageTable->setResizeNonPowerOfTwoHint(false);
+    _pageTable->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+    _pageTable->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+
+    _zeros.assign(numBricks, 0);
+    auto feedbackImage = new osg::Image;
+    feedbackImage->setImage(_grid.x(), _grid.y(), _grid.z(), GL_R8UI, GL_RED_INTEGER,
+        GL_UNSIGNED_BYTE, _zeros.data(), osg::Image::NO_DELETE, 1);
+
+    _feedback = new osg::Texture3D(feedbackImage);
+    _feedback->setInternalFormat(GL_R8UI);
+    _feedback->setResizeNonPowerOfTwoHint(false);
+    _feedback->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+    _feedback->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+
+    _pages.assign(numBricks, Page());
+    _slots.assign(numSlots, Slot());
+    _freeSlots.clear();
+    for (auto i = numSlots - 1; i >= 0; --i)
+    {
+        _freeSlots.push_back(i);
+    }
+    _pool.reset(new ThreadPool);
+
+    OSG_NOTICE << "Bricked volume " << file << " " << _size.x() << "x" << _size.y() << "x"
+               << _size.z() << ", " << numBricks << " bricks, " << numSlots
+               << " resident at most, atlas uses " << numSlots * _brickBytes / 1048576.0
+               << " MiB." << std::endl;
+}
+
+void BrickedVolume::setup(
+    osg::Group* parent, unsigned unit, osg::Texture::FilterMode filter)
+{
+    _atlas->setFilter(osg::Texture::MIN_FILTER, filter);
+    _atlas->setFilter(osg::Texture::MAG_FILTER, filter);
+
+    auto ss = parent->getOrCreateStateSet();
+    ss->setDataVariance(osg::Object::DYNAMIC);
+    ss->setTextureAttributeAndModes(unit, _atlas);
+    ss->setTextureAttribute(pageTableUnit, _pageTable);
+    ss->setAttribute(new osg::BindImageTexture(
+        0, _feedback, osg::BindImageTexture::WRITE_ONLY, GL_R8UI));
+    ss->addUniform(new osg::Uniform("toy_BrickAtlas", static_cast<int>(unit)));
+    ss->addUniform(new osg::Uniform("toy_BrickPageTable", static_cast<int>(pageTableUnit)));
+    ss->addUniform(new osg::Uniform("toy_BrickFeedback", 0));
+    ss->addUniform(new osg::Uniform(
+        "toy_BrickVolumeSize", osg::Vec3(_size.x(), _size.y(), _size.z())));
+    ss->addUniform(new osg::Uniform("toy_BrickAtlasSize",
+        osg::Vec3(_atlasSlots.x(), _atlasSlots.y(), _atlasSlots.z()) * _storedSize));
+    ss->addUniform(new osg::Uniform("toy_BrickSize", osg::Vec2(_brickSize, _storedSize)));
+
+    // draw after the scene, feedback of this frame must be complete.
+    _drawable = osgf::createDrawable(
+        [this](osg::RenderInfo& renderInfo, const osg::Drawable*) { draw(renderInfo); });
+    _drawable->setName("BrickedVolume");
+    _drawable->setUseDisplayList(false);
+    _drawable->setCullingActive(false);
+    _drawable->getOrCreateStateSet()->setRenderBinDetails(1000, "RenderBin");
+    parent->addChild(_drawable);
+}
+
+bool BrickedVolume::update()
+{
+    if (!_atlas)
+    {
+        return false;
+    }
+
+    std::vector<Upload> uploaded;
+    std::vector<unsigned char> feedback;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        for (auto iter = _loads.begin(); iter != _loads.end();)
+        {
+            if (iter->data.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                ++iter;
+                continue;
+            }
+
+            Upload upload;
+            upload.brick = iter->brick;
+            upload.slot = iter->slot;
+            upload.data = iter->data.get();
+            _uploads.push_back(std::move(upload));
+            iter = _loads.erase(iter);
+        }
+
+        uploaded.swap(_uploaded);
+        if (_feedbackReady)
+        {
+            feedback.swap(_feedbackData);
+            _feedbackReady = false;
+        }
+    }
+
+    auto changed = !uploaded.empty();
+    for (auto& upload: uploaded)
+    {
+        _pages[upload.brick].state = RESIDENT;
+        setPage(upload.brick, upload.slot);
+        auto& slot = _slots[upload.slot];
+        slot.touched = _feedbackIndex;
+        slot.lru = _lru.insert(_lru.end(), upload.slot);
+    }
+
+    if (!feedback.empty())
+    {
+        ++_feedbackIndex;
+
+        // touch every resident brick first, none of them may be evicted for a missing one.
+        std::vector<int> missingBricks;
+        for (auto i = 0u; i < feedback.size(); ++i)
+        {
+            if (!feedback[i])
+            {
+                continue;
+            }
+
+            auto& page = _pages[i];
+            if (page.state == RESIDENT)
+            {
+                auto& slot = _slots[page.slot];
+                slot.touched = _feedbackIndex;
+                _lru.splice(_lru.end(), _lru, slot.lru);
+            }
+            else
+            {
+                missingBricks.push_back(i);
+            }
+        }
+
+        auto missing = missingBricks.size();
+        for (auto i: missingBricks)
+        {
+            auto& page = _pages[i];
+            if (page.state == LOADING || static_cast<int>(_loads.size()) >= _maxLoads)
+            {
+                continue;
+            }
+
+            auto slot = acquireSlot();
+            if (slot == -1)
+            {
+                if (!_cacheFullReported)
+                {
+                    OSG_WARN << "Bricks of " << _fileName << " touched in one frame "
+                             << "exceed the brick cache." << std::endl;
+                    _cacheFullReported = true;
+                }
+                // nothing can be loaded until the view changes.
+                missing = 0;
+                break;
+            }
+            changed = true;
+
+            page.state = LOADING;
+            page.slot = slot;
+            _slots[slot].brick = i;
+
+            auto src = _file->data() + _dataOffset + i * _brickBytes;
+            auto size = _brickBytes;
+            Load load;
+            load.brick = i;
+            load.slot = slot;
+            load.data = _pool->submit([src, size]() {
+                // faults pages of the brick in on the worker.
+                return std::vector<unsigned char>(src, src + size);
+            });
+            _loads.push_back(std::move(load));
+        }
+
+        _quietFeedbacks = missing == 0 ? _quietFeedbacks + 1 : 0;
+    }
+
+    if (changed)
+    {
+        _pageImage->dirty();
+    }
+    return changed;
+}
+
+bool BrickedVolume::isIdle() const
+{
+    if (!_atlas)
+    {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _loads.empty() && _uploads.empty() && _uploaded.empty() &&
+           _quietFeedbacks >= quietFeedbacks;
+}
+
+void BrickedVolume::draw(osg::RenderInfo& renderInfo)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto& state = *renderInfo.getState();
+    auto extensions = state.get<osg::GLExtensions>();
+    auto frame = static_cast<int>(state.getFrameStamp()->getFrameNumber());
+
+    extensions->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    // bricks are written after the scene, an evicted slot isn't sampled in this frame.
+    if (!_uploads.empty())
+    {
+        state.applyTextureAttribute(0, _atlas.get());
+        for (auto& upload: _uploads)
+        {
+            auto origin = getSlotOrigin(upload.slot);
+            extensions->glTexSubImage3D(GL_TEXTURE_3D, 0, origin.x(), origin.y(),
+                origin.z(), _storedSize, _storedSize, _storedSize, _pixelFormat, _dataType,
+                upload.data.data());
+            upload.data.clear();
+            _uploaded.push_back(std::move(upload));
+        }
+        _uploads.clear();
+    }
+
+    if (_pbo == 0)
+    {
+        extensions->glGenBuffers(1, &_pbo);
+        extensions->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, _pbo);
+        extensions->glBufferData(
+            GL_PIXEL_PACK_BUFFER_ARB, _zeros.size(), 0, GL_STREAM_READ_ARB);
+    }
+    extensions->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, _pbo);
+
+    // feedback of last frame should be ready by now.
+    if (_readFrame != -1 && _readFrame < frame)
+    {
+        auto data = extensions->glMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+        if (data)
+        {
+            auto begin = static_cast<const unsigned char*>(data);
+            _feedbackData.assign(begin, begin + _zeros.size());
+            _feedbackReady = true;
+            extensions->glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
+        }
+        else
+        {
+            OSG_WARN << "Failed to map feedback of " << _fileName << std::endl;
+        }
+        _readFrame = -1;
+    }
+
+    if (_readFrame == -1)
+    {
+        extensions->glMemoryBarrier(
+            GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+        state.applyTextureAttribute(0, _feedback.get());
+        glGetTexImage(GL_TEXTURE_3D, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, 0);
+        _readFrame = frame;
+
+        extensions->glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, _grid.x(), _grid.y(),
+            _grid.z(), GL_RED_INTEGER, GL_UNSIGNED_BYTE, _zeros.data());
+    }
+
+    extensions->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+}
+
+int BrickedVolume::acquireSlot()
+{
+    if (!_freeSlots.empty())
+    {
+        auto slot = _freeSlots.back();
+        _freeSlots.pop_back();
+        return slot;
+    }
+
+    if (_lru.empty() || _slots[_lru.front()].touched == _feedbackIndex)
+    {
+        return -1;
+    }
+
+    auto slot = _lru.front();
+    _lru.pop_front();
+    auto& page = _pages[_slots[slot].brick];
+    page.state = EMPTY;
+    page.slot = -1;
+    setPage(_slots[slot].brick, -1);
+    _slots[slot].brick = -1;
+    return slot;
+}
+
+void BrickedVolume::setPage(int brick, int slot)
+{
+    auto texel = _pageImage->data() + brick * 4;
+    if (slot == -1)
+    {
+        std::memset(texel, 0, 4);
+        return;
+    }
+
+    auto origin = getSlotOrigin(slot) / _storedSize;
+    texel[0] = origin.x();
+    texel[1] = origin.y();
+    texel[2] = origin.z();
+    texel[3] = 255;
+}
+
+osg::Vec3i BrickedVolume::getSlotOrigin(int slot) const
+{
+    return osg::Vec3i(slot % _atlasSlots.x(), slot / _atlasSlots.x() % _atlasSlots.y(),
+               slot / (_atlasSlots.x() * _atlasSlots.y())) *
+           _storedSize;
+}
+
+void BrickedVolume::convert(const std::string& raw, const osg::Vec3i& size,
+    GLenum pixelFormat, GLenum dataType, const std::string& file, int brickSize)
+{
+    if (getInternalFormat(pixelFormat, dataType) == 0 || brickSize <= 0)
+    {
+        throw std::runtime_error("unsupported pixel format, type or brick size");
+    }
+
+    MappedFile src(raw);
+    auto pixelSize = osg::Image::computePixelSizeInBits(pixelFormat, dataType) / 8;
+    if (src.size() < static_cast<std::size_t>(size.x()) * size.y() * size.z() * pixelSize)
+    {
+        throw std::runtime_error(raw + " is smaller than its size");
+    }
+
+    std::ofstream ofs(file, std::ios::binary);
+    if (!ofs)
+    {
+        throw std::runtime_error("failed to write " + file);
+    }
+
+    Header header;
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.size[0] = size.x();
+    header.size[1] = size.y();
+    header.size[2] = size.z();
+    header.brickSize = brickSize;
+    header.border = border;
+    header.pixelFormat = pixelFormat;
+    header.dataType = dataType;
+    std::vector<char> head(dataAlignment, 0);
+    std::memcpy(head.data(), &header, sizeof(header));
+    ofs.write(head.data(), head.size());
+
+    auto grid = getGrid(size, brickSize);
+    auto stored = brickSize + border * 2;
+    std::vector<unsigned char> brick(stored * stored * stored * pixelSize);
+    for (auto bz = 0; bz < grid.z(); ++bz)
+    {
+        for (auto by = 0; by < grid.y(); ++by)
+        {
+            for (auto bx = 0; bx < grid.x(); ++bx)
+            {
+                // voxels out of the volume are clamped to its edge.
+                auto dst = brick.data();
+                for (auto z = 0; z < stored; ++z)
+                {
+                    auto vz =
+                        osg::clampBetween(bz * brickSize - border + z, 0, size.z() - 1);
+                    for (auto y = 0; y < stored; ++y)
+                    {
+                        auto vy =
+                            osg::clampBetween(by * brickSize - border + y, 0, size.y() - 1);
+                        auto row = src.data() +
+                                   (static_cast<std::size_t>(vz) * size.y() + vy) *
+                                       size.x() * pixelSize;
+                        for (auto x = 0; x < stored; ++x, dst += pixelSize)
+                        {
+                            auto vx = osg::clampBetween(
+                                bx * brickSize - border + x, 0, size.x() - 1);
+                            std::memcpy(dst, row + vx * pixelSize, pixelSize);
+                        }
+                    }
+                }
+                ofs.write(reinterpret_cast<const char*>(brick.data()), brick.size());
+            }
+        }
+        OSG_NOTICE << "Bricked " << bz + 1 << "/" << grid.z() << " layers." << std::endl;
+    }
+
+    if (!ofs)
+    {
+        throw std::runtime_error("failed to write " + file);
+    }
+}
+
+}  // namespace ntoy
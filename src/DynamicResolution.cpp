@@ -0,0 +1,232 @@
+#include <DynamicResolution.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <osg/GLExtensions>
+#include <osg/Program>
+
+#include <OsgFactory.h>
+#include <RenderTargetPool.h>
+
+namespace ntoy
+{
+
+namespace
+{
+
+auto upscaleFragSource = R"0(
+uniform sampler2D toy_Source;
+uniform vec2 toy_SourceSize;  // scaled frame in pixels
+uniform vec2 toy_WindowSize;  // also size of toy_Source
+
+vec3 fetch(vec2 p)
+{
+    p = clamp(p, vec2(0.5), toy_SourceSize - 0.5);
+    return texture2D(toy_Source, p / toy_WindowSize).rgb;
+}
+
+void main( void )
+{
+    vec2 p = gl_FragCoord.xy / toy_WindowSize * toy_SourceSize;
+    vec3 c = fetch(p);
+
+#ifdef SHARP
+    // unsharp mask clamped to range of the neighbors.
+    vec3 n = fetch(p + vec2(0, 1));
+    vec3 s = fetch(p - vec2(0, 1));
+    vec3 e = fetch(p + vec2(1, 0));
+    vec3 w = fetch(p - vec2(1, 0));
+    vec3 lo = min(c, min(min(n, s), min(e, w)));
+    vec3 hi = max(c, max(max(n, s), max(e, w)));
+    c = clamp(c + (4.0 * c - n - s - e - w) * 0.25, lo, hi);
+#endif
+
+    gl_FragColor = vec4(c, 1);
+})0";
+
+// Ignore changes smaller than this fraction of current scale, a frame time that jitters
+// around the target shouldn't resize the frame every frame.
+const float scaleTolerance = 0.05f;
+
+}  // namespace
+
+DynamicResolution::DynamicResolution(RenderTargetPool& pool) : _pool(pool) {}
+
+void DynamicResolution::setup(osg::Group* parent, osg::Node* scene,
+    const std::string& vertexSource, int width, int height)
+{
+    _parent = parent;
+    _width = width;
+    _height = height;
+
+    _camera = osgf::createRttCamera(0, 0, width, height, osg::Camera::FRAME_BUFFER_OBJECT);
+    _camera->setName("DynamicResolution");
+    _camera->setRenderOrder(osg::Camera::PRE_RENDER, renderOrder);
+    _camera->setImplicitBufferAttachmentMask(0, 0);
+    _camera->setInitialDrawCallback(static_cast<osg::Camera::DrawCallback*>(
+        osgf::createDrawCallback(
+            [this](osg::RenderInfo& renderInfo) { beginQuery(renderInfo); })));
+    _camera->setFinalDrawCallback(static_cast<osg::Camera::DrawCallback*>(
+        osgf::createDrawCallback(
+            [this](osg::RenderInfo& renderInfo) { endQuery(renderInfo); })));
+    _camera->addChild(scene);
+    parent->addChild(_camera);
+
+    auto program = new osg::Program;
+    program->addShader(new osg::Shader(osg::Shader::VERTEX, vertexSource));
+    auto header = _filter == SHARP ? "#version 120\n#define SHARP\n" : "#version 120\n";
+    program->addShader(new osg::Shader(
+        osg::Shader::FRAGMENT, std::string(header) + upscaleFragSource));
+
+    _sourceSizeUniform = new osg::Uniform("toy_SourceSize", osg::Vec2());
+    _windowSizeUniform = new osg::Uniform("toy_WindowSize", osg::Vec2());
+
+    _display = new osg::Group;
+    _display->setName("DynamicResolutionDisplay");
+    auto ss = _display->getOrCreateStateSet();
+    ss->setDataVariance(osg::Object::DYNAMIC);
+    ss->setAttributeAndModes(program);
+    ss->addUniform(new osg::Uniform("toy_Source", 0));
+    ss->addUniform(_sourceSizeUniform);
+    ss->addUniform(_windowSizeUniform);
+    _display->addChild(osgf::getNdcQuad());
+    parent->addChild(_display);
+
+    allocateTarget();
+}
+
+void DynamicResolution::resize(int width, int height)
+{
+    if (!_parent || (width == _width && height == _height))
+    {
+        return;
+    }
+
+    _width = width;
+    _height = height;
+    _pool.release(_texture);
+    _pool.trim();
+    allocateTarget();
+}
+
+void DynamicResolution::update()
+{
+    if (!_parent)
+    {
+        return;
+    }
+
+    double gpuTime = -1;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::swap(gpuTime, _gpuTime);
+    }
+
+    if (gpuTime > 0)
+    {
+        // gpu time is proportional to pixels, scale applies to both axes.
+        auto ideal = _scale * std::sqrt(_targetTime / gpuTime);
+        ideal = std::max<double>(_minScale, std::min(1.0, ideal));
+        if (std::abs(ideal - _scale) > _scale * scaleTolerance ||
+            (ideal == 1 && _scale != 1))
+        {
+            // half way, the next measure comes a few frames later.
+            float scale = ideal == 1 ? 1 : _scale + (ideal - _scale) * 0.5;
+            OSG_INFO << "Render scale " << scale << ", gpu time " << gpuTime << " ms."
+                     << std::endl;
+            _scale = scale;
+        }
+    }
+
+    auto size = getRenderSize();
+    _camera->setViewport(0, 0, size.x(), size.y());
+    _sourceSizeUniform->set(size);
+}
+
+osg::Vec2 DynamicResolution::getRenderSize() const
+{
+    return osg::Vec2(std::max(1.0f, std::round(_width * _scale)),
+        std::max(1.0f, std::round(_height * _scale)));
+}
+
+void DynamicResolution::beginQuery(osg::RenderInfo& renderInfo)
+{
+    auto& state = *renderInfo.getState();
+    auto extensions = state.get<osg::GLExtensions>();
+    if (!extensions->isTimerQuerySupported)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // keep the latest available frame.
+    auto frame = state.getFrameStamp()->getFrameNumber();
+    auto latestFrame = 0u;
+    for (auto i = 0; i < numQueries; ++i)
+    {
+        if (!_pending[i])
+        {
+            continue;
+        }
+
+        GLint available = 0;
+        extensions->glGetQueryObjectiv(
+            _queries[i][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            continue;
+        }
+
+        GLuint64 begin = 0;
+        GLuint64 end = 0;
+        extensions->glGetQueryObjectui64v(_queries[i][0], GL_QUERY_RESULT, &begin);
+        extensions->glGetQueryObjectui64v(_queries[i][1], GL_QUERY_RESULT, &end);
+        _pending[i] = false;
+        if (_queryFrames[i] >= latestFrame)
+        {
+            latestFrame = _queryFrames[i];
+            _gpuTime = (end - begin) * 1e-6;
+        }
+    }
+
+    auto slot = frame % numQueries;
+    if (!_queries[slot][0])
+    {
+        extensions->glGenQueries(2, _queries[slot]);
+    }
+
+    // results of a frame this old are dropped.
+    _pending[slot] = false;
+    _queryFrames[slot] = frame;
+    extensions->glQueryCounter(_queries[slot][0], GL_TIMESTAMP);
+    _activeQuery = slot;
+}
+
+void DynamicResolution::endQuery(osg::RenderInfo& renderInfo)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_activeQuery < 0)
+    {
+        return;
+    }
+
+    auto extensions = renderInfo.getState()->get<osg::GLExtensions>();
+    extensions->glQueryCounter(_queries[_activeQuery][1], GL_TIMESTAMP);
+    _pending[_activeQuery] = true;
+    _activeQuery = -1;
+}
+
+void DynamicResolution::allocateTarget()
+{
+    _texture = _pool.acquire(_width, _height, GL_RGBA8);
+    _camera->attach(osg::Camera::COLOR_BUFFER0, _texture);
+    _camera->dirtyAttachmentMap();
+    _display->getStateSet()->setTextureAttribute(0, _texture);
+    _windowSizeUniform->set(osg::Vec2(_width, _height));
+    OSG_NOTICE << "Dynamic resolution target uses " << _pool.getBytes() / 1048576.0
+               << " MiB." << std::endl;
+}
+
+}  // namespace ntoy
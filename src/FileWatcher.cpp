@@ -0,0 +1,408 @@
+#include <FileWatcher.h>
+
+#ifdef WIN32
+
+#else
+#    include <sys/stat.h>
+#    include <sys/types.h>
+#    include <unistd.h>
+#endif
+
+#ifdef __linux__
+#    include <sys/inotify.h>
+#endif
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <osg/Notify>
+#include <osgDB/FileNameUtils>
+
+#include <StringUtil.h>
+
+namespace ntoy
+{
+
+namespace
+{
+
+const char* statErrorToString(int errorNumber)
+{
+    switch (errorNumber)
+    {
+        case EACCES:
+            return "EACCES";
+        case EBADF:
+            return "EBADF";
+        case EFAULT:
+            return "EFAULT";
+        case ELOOP:
+            return "ELOOP";
+        case ENAMETOOLONG:
+            return "ENAMETOOLONG";
+        case ENOENT:
+            return "ENOENT";
+        case ENOMEM:
+            return "ENOMEM";
+        case ENOTDIR:
+            return "ENOTDIR";
+        case EOVERFLOW:
+            return "EOVERFLOW";
+        default:
+            return "";
+    }
+}
+
+std::uint64_t hashFile(const std::string& file)
+{
+    std::ifstream ifs(file, std::ios::binary);
+    if (!ifs)
+    {
+        throw FileWatchError("failed to open " + file);
+    }
+
+    auto h = sutil::hash("", 0);
+    char buf[65536];
+    while (ifs.read(buf, sizeof(buf)) || ifs.gcount() > 0)
+    {
+        h = sutil::hash(buf, ifs.gcount(), h);
+    }
+    return h;
+}
+
+bool operator==(const FileStamp& lhs, const FileStamp& rhs)
+{
+    return lhs.size == rhs.size && lhs.mtimeSec == rhs.mtimeSec &&
+           lhs.mtimeNsec == rhs.mtimeNsec && lhs.hash == rhs.hash;
+}
+
+bool operator!=(const FileStamp& lhs, const FileStamp& rhs)
+{
+    return !(lhs == rhs);
+}
+
+}  // namespace
+
+FileStamp getFileStamp(const std::string& file, bool hashContent)
+{
+    struct stat statbuf;
+    if (stat(file.c_str(), &statbuf) != 0)
+    {
+        throw FileWatchError(std::string("stat failed with ") + statErrorToString(errno));
+    }
+
+    FileStamp stamp;
+    stamp.size = statbuf.st_size;
+#ifdef WIN32
+    stamp.mtimeSec = statbuf.st_mtime;
+#else
+    stamp.mtimeSec = statbuf.st_mtim.tv_sec;
+    stamp.mtimeNsec = statbuf.st_mtim.tv_nsec;
+#endif
+
+    if (hashContent)
+    {
+        stamp.hash = hashFile(file);
+    }
+
+    return stamp;
+}
+
+void StatFileWatcher::addFile(const std::string& file)
+{
+    // invalid stamp, reported by next poll.
+    _files.insert(std::make_pair(file, FileStamp()));
+}
+
+void StatFileWatcher::poll(FileSet& changedFiles)
+{
+    for (auto& item: _files)
+    {
+        try
+        {
+            auto stamp = getFileStamp(item.first);
+            _failedFiles.erase(item.first);
+            if (stamp != item.second)
+            {
+                item.second = stamp;
+                changedFiles.insert(item.first);
+            }
+        }
+        catch (const FileWatchError& e)
+        {
+            // warn once until it can be stat again, deleted files are polled forever.
+            if (_failedFiles.insert(item.first).second)
+            {
+                OSG_WARN << item.first << " : " << e.what() << std::endl;
+            }
+            else
+            {
+                OSG_INFO << item.first << " : " << e.what() << std::endl;
+            }
+        }
+    }
+}
+
+void ChangeCoalescer::add(const FileSet& files, double time)
+{
+    for (auto& file: files)
+    {
+        // pretend never delivered file has been quiet for long enough
+        _pendingFiles[file] = _stamps.count(file) ? time : time - _quietPeriod;
+    }
+}
+
+bool ChangeCoalescer::collect(double time, FileSet& settledFiles)
+{
+    auto settled = false;
+    for (auto iter = _pendingFiles.begin(); iter != _pendingFiles.end();)
+    {
+        if (time - iter->second < _quietPeriod)
+        {
+            ++iter;
+            continue;
+        }
+
+        const auto& file = iter->first;
+        FileStamp stamp;
+        try
+        {
+            stamp = getFileStamp(file, _hashContent);
+        }
+        catch (const FileWatchError& e)
+        {
+            OSG_INFO << file << " : " << e.what() << std::endl;
+
+            // never delivered file doesn't exist yet, the watcher reports it once it's
+            // created. Retrying would wake the viewer forever.
+            if (!_stamps.count(file))
+            {
+                iter = _pendingFiles.erase(iter);
+                continue;
+            }
+
+            // might be in the middle of a rename, try again later.
+            iter->second = time;
+            ++iter;
+            continue;
+        }
+
+        // only size and hash matter if content is hashed
+        if (_hashContent)
+        {
+            stamp.mtimeSec = 0;
+            stamp.mtimeNsec = 0;
+        }
+
+        auto stampIter = _stamps.find(file);
+        if (stampIter == _stamps.end() || stampIter->second != stamp)
+        {
+            _stamps[file] = stamp;
+            settledFiles.insert(file);
+            settled = true;
+        }
+        else
+        {
+            OSG_INFO << file << " is not changed, ignored." << std::endl;
+        }
+
+        iter = _pendingFiles.erase(iter);
+    }
+
+    return settled;
+}
+
+double ChangeCoalescer::getNextSettleTime() const
+{
+    auto time = -1.0;
+    for (auto& item: _pendingFiles)
+    {
+        if (time < 0 || item.second + _quietPeriod < time)
+        {
+            time = item.second + _quietPeriod;
+        }
+    }
+    return time;
+}
+
+#ifdef __linux__
+
+namespace
+{
+
+// Only react to finished writes. IN_MODIFY is not used, it fires for every chunk.
+const unsigned watchMask =
+    IN_CLOSE_WRITE | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+}  // namespace
+
+InotifyFileWatcher::InotifyFileWatcher()
+{
+    _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_fd == -1)
+    {
+        throw FileWatchError(std::string("inotify_init1 failed : ") + std::strerror(errno));
+    }
+}
+
+InotifyFileWatcher::~InotifyFileWatcher()
+{
+    if (_fd != -1)
+    {
+        close(_fd);
+    }
+}
+
+void InotifyFileWatcher::addFile(const std::string& file)
+{
+    _pendingFiles.insert(file);
+
+    auto path = osgDB::getFilePath(file);
+    if (path.empty())
+    {
+        path = ".";
+    }
+
+    // Same directory always return the same wd, no matter how it's spelled.
+    auto wd = inotify_add_watch(_fd, path.c_str(), watchMask);
+    if (wd == -1)
+    {
+        OSG_WARN << "Failed to watch " << path << " : " << std::strerror(errno)
+                 << ", fall back to stat." << std::endl;
+        fallback({file});
+        return;
+    }
+
+    auto& directory = _directories[wd];
+    directory.path = path;
+    directory.files[osgDB::getSimpleFileName(file)].insert(file);
+}
+
+void InotifyFileWatcher::poll(FileSet& changedFiles)
+{
+    changedFiles.insert(_pendingFiles.begin(), _pendingFiles.end());
+    _pendingFiles.clear();
+
+    // drain the queue, one read is usually enough.
+    alignas(inotify_event) char buf[4096];
+    while (true)
+    {
+        auto len = read(_fd, buf, sizeof(buf));
+        if (len == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (len <= 0)
+        {
+            if (len == -1 && errno != EAGAIN)
+            {
+                OSG_WARN << "Failed to read inotify events : " << std::strerror(errno)
+                         << std::endl;
+            }
+            break;
+        }
+
+        for (auto p = buf; p < buf + len;)
+        {
+            auto event = reinterpret_cast<const inotify_event*>(p);
+            handleEvent(event->wd, event->mask, event->len > 0 ? event->name : "",
+                changedFiles);
+            p += sizeof(inotify_event) + event->len;
+        }
+    }
+
+    if (_statWatcher)
+    {
+        _statWatcher->poll(changedFiles);
+    }
+}
+
+void InotifyFileWatcher::handleEvent(
+    int wd, unsigned mask, const char* name, FileSet& changedFiles)
+{
+    if (mask & IN_Q_OVERFLOW)
+    {
+        OSG_NOTICE << "inotify queue overflow, treat all files as changed." << std::endl;
+        for (auto& item: _directories)
+        {
+            for (auto& file: item.second.files)
+            {
+                changedFiles.insert(file.second.begin(), file.second.end());
+            }
+        }
+        return;
+    }
+
+    auto iter = _directories.find(wd);
+    if (iter == _directories.end())
+    {
+        return;
+    }
+
+    auto& directory = iter->second;
+    if (mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+    {
+        OSG_WARN << directory.path << " is gone, fall back to stat." << std::endl;
+        FileSet files;
+        for (auto& file: directory.files)
+        {
+            files.insert(file.second.begin(), file.second.end());
+        }
+
+        if (!(mask & IN_IGNORED))
+        {
+            inotify_rm_watch(_fd, wd);
+        }
+        _directories.erase(iter);
+        fallback(files);
+        return;
+    }
+
+    auto fileIter = directory.files.find(name);
+    if (fileIter != directory.files.end())
+    {
+        changedFiles.insert(fileIter->second.begin(), fileIter->second.end());
+    }
+}
+
+void InotifyFileWatcher::fallback(const FileSet& files)
+{
+    if (!_statWatcher)
+    {
+        _statWatcher = new StatFileWatcher;
+    }
+
+    for (auto& file: files)
+    {
+        _statWatcher->addFile(file);
+    }
+}
+
+#endif
+
+FileWatcher* createFileWatcher()
+{
+    auto name = std::getenv("NTOY_FILE_WATCHER");
+    if (name && std::strcmp(name, "stat") == 0)
+    {
+        return new StatFileWatcher;
+    }
+
+#ifdef __linux__
+    try
+    {
+        return new InotifyFileWatcher;
+    }
+    catch (const FileWatchError& e)
+    {
+        OSG_WARN << e.what() << ", fall back to stat." << std::endl;
+    }
+#endif
+
+    return new StatFileWatcher;
+}
+
+}  // namespace ntoy
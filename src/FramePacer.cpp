@@ -0,0 +1,226 @@
+#include <FramePacer.h>
+
+#ifdef __linux__
+#    include <poll.h>
+#    include <sys/eventfd.h>
+#    include <time.h>
+#    include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+
+#include <osg/Notify>
+
+namespace toy
+{
+
+namespace
+{
+
+#ifdef __linux__
+
+timespec toTimespec(double seconds)
+{
+    timespec ts;
+    ts.tv_sec = static_cast<time_t>(std::floor(seconds));
+    ts.tv_nsec = static_cast<long>((seconds - ts.tv_sec) * 1e9);
+    return ts;
+}
+
+#endif
+
+}  // namespace
+
+FramePacer::FramePacer()
+{
+#ifdef __linux__
+    _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wakeFd == -1)
+    {
+        OSG_WARN << "Failed to create eventfd, wake falls back to polling." << std::endl;
+    }
+#endif
+}
+
+FramePacer::~FramePacer()
+{
+#ifdef __linux__
+    if (_wakeFd != -1)
+    {
+        close(_wakeFd);
+    }
+#endif
+}
+
+double FramePacer::now() const
+{
+#ifdef __linux__
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+void FramePacer::sleepUntil(double deadline)
+{
+    auto sleepDeadline = deadline - _spinTime;
+    if (sleepDeadline > now())
+    {
+#ifdef __linux__
+        // absolute deadline, an interrupted sleep resumes without drift.
+        auto ts = toTimespec(sleepDeadline);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR)
+        {
+        }
+#else
+        std::this_thread::sleep_for(std::chrono::duration<double>(sleepDeadline - now()));
+#endif
+    }
+
+    while (now() < deadline)
+    {
+    }
+}
+
+bool FramePacer::wait(double timeout)
+{
+    auto end = timeout < 0 ? -1.0 : now() + timeout;
+    while (true)
+    {
+        auto t = now();
+        double wakeTime;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_woken || (_wakeTime >= 0 && _wakeTime <= t))
+            {
+                _woken = false;
+                if (_wakeTime <= t)
+                {
+                    _wakeTime = -1;
+                }
+                return true;
+            }
+            wakeTime = _wakeTime;
+        }
+
+        if (end >= 0 && end <= t)
+        {
+            return false;
+        }
+
+        // the earlier of timeout and wake time, -1 if there is none.
+        auto until = end;
+        if (wakeTime >= 0 && (until < 0 || wakeTime < until))
+        {
+            until = wakeTime;
+        }
+
+#ifdef __linux__
+        if (_wakeFd != -1)
+        {
+            std::vector<pollfd> pfds;
+            pfds.push_back({_wakeFd, POLLIN, 0});
+            for (auto fd: _fds)
+            {
+                pfds.push_back({fd, POLLIN, 0});
+            }
+
+            timespec ts;
+            if (until >= 0)
+            {
+                ts = toTimespec(std::max(0.0, until - t));
+            }
+
+            auto n = ppoll(pfds.data(), pfds.size(), until >= 0 ? &ts : 0, 0);
+            if (n == -1)
+            {
+                if (errno != EINTR)
+                {
+                    OSG_WARN << "ppoll failed : " << errno << std::endl;
+                    return true;
+                }
+                continue;
+            }
+
+            if (pfds[0].revents & POLLIN)
+            {
+                // state is checked on next loop.
+                std::uint64_t value;
+                while (read(_wakeFd, &value, sizeof(value)) > 0)
+                {
+                }
+            }
+
+            for (auto i = 1u; i < pfds.size(); ++i)
+            {
+                if (pfds[i].revents)
+                {
+                    return true;
+                }
+            }
+            continue;
+        }
+#endif
+
+        // no descriptor to block on, check again shortly.
+        auto step = 0.01;
+        if (until >= 0)
+        {
+            step = std::min(step, std::max(0.0, until - t));
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(step));
+    }
+}
+
+void FramePacer::addFileDescriptor(int fd)
+{
+    if (fd != -1 && std::find(_fds.begin(), _fds.end(), fd) == _fds.end())
+    {
+        _fds.push_back(fd);
+    }
+}
+
+void FramePacer::wake()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _woken = true;
+    }
+    signal();
+}
+
+void FramePacer::wakeAt(double time)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_wakeTime < 0 || time < _wakeTime)
+        {
+            _wakeTime = time;
+        }
+    }
+    signal();
+}
+
+void FramePacer::signal()
+{
+#ifdef __linux__
+    if (_wakeFd != -1)
+    {
+        std::uint64_t value = 1;
+        if (write(_wakeFd, &value, sizeof(value)) == -1 && errno != EAGAIN)
+        {
+            OSG_WARN << "Failed to wake frame pacer : " << errno << std::endl;
+        }
+    }
+#endif
+}
+
+}  // namespace toy
@@ -0,0 +1,440 @@
+#include <FrameProfiler.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+#include <stdexcept>
+
+#include <osg/Camera>
+#include <osg/GLExtensions>
+#include <osg/Stats>
+#include <osg/observer_ptr>
+#include <osgDB/FileNameUtils>
+#include <osgViewer/Viewer>
+
+#include <OsgFactory.h>
+#include <OsgQuery.h>
+
+namespace toy
+{
+
+namespace
+{
+
+// Query results of a frame are expected to be available this many frames later.
+const unsigned frameLag = 6;
+
+// Scene is searched for new cameras this often, or when scene data is replaced.
+const unsigned rescanInterval = 60;
+
+double percentile(const std::vector<double>& sortedSamples, double p)
+{
+    auto rank = static_cast<std::size_t>(std::ceil(p / 100.0 * sortedSamples.size()));
+    return sortedSamples[std::min(std::max<std::size_t>(rank, 1), sortedSamples.size()) - 1];
+}
+
+std::string escapeJson(const std::string& s)
+{
+    std::string result;
+    for (auto c: s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result;
+}
+
+}  // namespace
+
+SampleSummary summarize(std::vector<double> samples)
+{
+    SampleSummary summary;
+    if (samples.empty())
+    {
+        return summary;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    summary.count = samples.size();
+    summary.min = samples.front();
+    summary.max = samples.back();
+    summary.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    summary.p50 = percentile(samples, 50);
+    summary.p90 = percentile(samples, 90);
+    summary.p99 = percentile(samples, 99);
+    return summary;
+}
+
+struct FrameProfiler::CameraTimer
+{
+    static const int numQueries = 4;
+
+    std::string name;
+    osg::observer_ptr<osg::Camera> camera;
+    osg::ref_ptr<osg::Camera::DrawCallback> initialCallback;
+    osg::ref_ptr<osg::Camera::DrawCallback> finalCallback;
+
+    GLuint queries[numQueries] = {};
+    unsigned queryFrames[numQueries] = {};
+    bool pending[numQueries] = {};
+    int activeQuery = -1;
+};
+
+FrameProfiler::FrameProfiler(const std::string& file)
+    : _json(osgDB::getLowerCaseFileExtension(file) == "json")
+    , _ofs(file)
+{
+    if (!_ofs)
+    {
+        throw std::runtime_error("Failed to open " + file);
+    }
+
+    _ofs << std::setprecision(6);
+    if (_json)
+    {
+        _ofs << "{\n  \"frames\": [";
+    }
+    else
+    {
+        _ofs << "frame,metric,ms\n";
+    }
+}
+
+FrameProfiler::~FrameProfiler() = default;
+
+void FrameProfiler::update(osgViewer::Viewer& viewer)
+{
+    if (_finished)
+    {
+        return;
+    }
+
+    auto frame = viewer.getFrameStamp()->getFrameNumber();
+    if (_firstFrame)
+    {
+        _firstFrame = false;
+        _nextFrame = frame + 1;
+
+        auto stats = viewer.getViewerStats();
+        stats->collectStats("frame_rate", true);
+        stats->collectStats("event", true);
+        stats->collectStats("update", true);
+
+        auto cameraStats = viewer.getCamera()->getStats();
+        if (cameraStats)
+        {
+            cameraStats->collectStats("rendering", true);
+        }
+    }
+
+    // forget dead cameras, reuse their queries.
+    for (auto iter = _timers.begin(); iter != _timers.end();)
+    {
+        if (iter->second->camera.valid())
+        {
+            ++iter;
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto query: iter->second->queries)
+        {
+            if (query)
+            {
+                _freeQueries.push_back(query);
+            }
+        }
+        iter = _timers.erase(iter);
+    }
+
+    attach(*viewer.getCamera(), "main");
+    auto scene = viewer.getSceneData();
+    if (scene && (scene != _scannedScene || frame >= _scanFrame + rescanInterval))
+    {
+        _scannedScene = scene;
+        _scanFrame = frame;
+        auto paths = osgq::searchNodes(*scene, &osg::Node::asCamera);
+        for (auto& path: paths)
+        {
+            auto camera = path.back()->asCamera();
+            auto name = camera->getName().empty() ? "camera" : camera->getName();
+            attach(*camera, name);
+        }
+    }
+    else
+    {
+        // cameras found before, their callbacks might have been replaced.
+        for (auto& item: _timers)
+        {
+            attach(*item.first, item.second->name);
+        }
+    }
+
+    while (_nextFrame + frameLag <= frame)
+    {
+        writeFrame(viewer, _nextFrame++);
+    }
+}
+
+void FrameProfiler::finish(osgViewer::Viewer& viewer)
+{
+    if (_finished)
+    {
+        return;
+    }
+
+    auto frame = viewer.getFrameStamp()->getFrameNumber();
+    while (_nextFrame <= frame)
+    {
+        writeFrame(viewer, _nextFrame++);
+    }
+
+    writeSummary();
+    _finished = true;
+}
+
+void FrameProfiler::attach(osg::Camera& camera, const std::string& name)
+{
+    auto& timer = _timers[&camera];
+    if (!timer)
+    {
+        timer = std::make_shared<CameraTimer>();
+        timer->camera = &camera;
+
+        // keep names unique, a camera keeps its name in its whole life.
+        auto index = _names[name]++;
+        timer->name = index == 0 ? name : name + "#" + std::to_string(index);
+    }
+
+    // wrap callbacks, again if someone replaced them.
+    auto rawTimer = timer.get();
+    if (camera.getInitialDrawCallback() != timer->initialCallback.get())
+    {
+        osg::ref_ptr<osg::Camera::DrawCallback> previous = camera.getInitialDrawCallback();
+        timer->initialCallback = static_cast<osg::Camera::DrawCallback*>(
+            osgf::createDrawCallback([this, rawTimer, previous](osg::RenderInfo& renderInfo) {
+                if (previous)
+                {
+                    (*previous)(renderInfo);
+                }
+                beginQuery(renderInfo, *rawTimer);
+            }));
+        camera.setInitialDrawCallback(timer->initialCallback);
+    }
+
+    if (camera.getFinalDrawCallback() != timer->finalCallback.get())
+    {
+        osg::ref_ptr<osg::Camera::DrawCallback> previous = camera.getFinalDrawCallback();
+        timer->finalCallback = static_cast<osg::Camera::DrawCallback*>(
+            osgf::createDrawCallback([this, rawTimer, previous](osg::RenderInfo& renderInfo) {
+                endQuery(renderInfo, *rawTimer);
+                if (previous)
+                {
+                    (*previous)(renderInfo);
+                }
+            }));
+        camera.setFinalDrawCallback(timer->finalCallback);
+    }
+}
+
+void FrameProfiler::beginQuery(osg::RenderInfo& renderInfo, CameraTimer& timer)
+{
+    auto& state = *renderInfo.getState();
+    auto extensions = state.get<osg::GLExtensions>();
+    if (!extensions->isTimerQuerySupported)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // Time elapsed queries can't nest, the active one lost its final callback or it's an
+    // enclosing camera, drop it.
+    if (_activeTimer)
+    {
+        extensions->glEndQuery(GL_TIME_ELAPSED);
+        _activeTimer->activeQuery = -1;
+        _activeTimer = 0;
+    }
+
+    // collect what's available.
+    for (auto i = 0; i < CameraTimer::numQueries; ++i)
+    {
+        if (!timer.pending[i])
+        {
+            continue;
+        }
+
+        GLint available = 0;
+        extensions->glGetQueryObjectiv(timer.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 elapsed = 0;
+            extensions->glGetQueryObjectui64v(timer.queries[i], GL_QUERY_RESULT, &elapsed);
+            _gpuTimes[timer.queryFrames[i]][timer.name] = elapsed * 1e-6;
+            timer.pending[i] = false;
+        }
+    }
+
+    auto frame = state.getFrameStamp()->getFrameNumber();
+    auto slot = frame % CameraTimer::numQueries;
+    if (timer.pending[slot])
+    {
+        OSG_INFO << "Drop gpu time of " << timer.name << " at frame " << timer.queryFrames[slot]
+                 << ", it's not available yet." << std::endl;
+        timer.pending[slot] = false;
+    }
+
+    auto& query = timer.queries[slot];
+    if (!query)
+    {
+        if (_freeQueries.empty())
+        {
+            extensions->glGenQueries(1, &query);
+        }
+        else
+        {
+            query = _freeQueries.back();
+            _freeQueries.pop_back();
+        }
+    }
+
+    extensions->glBeginQuery(GL_TIME_ELAPSED, query);
+    timer.queryFrames[slot] = frame;
+    timer.activeQuery = slot;
+    _activeTimer = &timer;
+}
+
+void FrameProfiler::endQuery(osg::RenderInfo& renderInfo, CameraTimer& timer)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_activeTimer != &timer)
+    {
+        return;
+    }
+
+    auto extensions = renderInfo.getState()->get<osg::GLExtensions>();
+    extensions->glEndQuery(GL_TIME_ELAPSED);
+    timer.pending[timer.activeQuery] = true;
+    timer.activeQuery = -1;
+    _activeTimer = 0;
+}
+
+void FrameProfiler::writeFrame(osgViewer::Viewer& viewer, unsigned frame)
+{
+    std::vector<std::pair<std::string, double>> metrics;
+    auto addMetric = [&metrics, frame](
+                         osg::Stats* stats, const char* attribute, const std::string& metric) {
+        double value = 0;
+        if (stats && stats->getAttribute(frame, attribute, value))
+        {
+            metrics.emplace_back(metric, value * 1000.0);
+        }
+    };
+
+    auto stats = viewer.getViewerStats();
+    addMetric(stats, "Frame duration", "frame");
+    addMetric(stats, "Event traversal time taken", "event");
+    addMetric(stats, "Update traversal time taken", "update");
+
+    auto cameraStats = viewer.getCamera()->getStats();
+    addMetric(cameraStats, "Cull traversal time taken", "cull");
+    addMetric(cameraStats, "Draw traversal time taken", "draw");
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto iter = _gpuTimes.find(frame);
+        if (iter != _gpuTimes.end())
+        {
+            for (auto& item: iter->second)
+            {
+                metrics.emplace_back("gpu:" + item.first, item.second);
+            }
+        }
+
+        // older ones will never be written.
+        _gpuTimes.erase(_gpuTimes.begin(), _gpuTimes.upper_bound(frame));
+    }
+
+    if (metrics.empty())
+    {
+        return;
+    }
+
+    if (_json)
+    {
+        _ofs << (_samples.empty() ? "\n" : ",\n") << "    {\"frame\": " << frame
+             << ", \"ms\": {";
+        for (auto i = 0u; i < metrics.size(); ++i)
+        {
+            _ofs << (i == 0 ? "" : ", ") << "\"" << escapeJson(metrics[i].first)
+                 << "\": " << metrics[i].second;
+        }
+        _ofs << "}}";
+    }
+    else
+    {
+        for (auto& metric: metrics)
+        {
+            _ofs << frame << "," << metric.first << "," << metric.second << "\n";
+        }
+    }
+
+    for (auto& metric: metrics)
+    {
+        _samples[metric.first].push_back(metric.second);
+    }
+}
+
+void FrameProfiler::writeSummary()
+{
+    if (_json)
+    {
+        _ofs << "\n  ],\n  \"summary\": {";
+    }
+
+    auto first = true;
+    for (auto& item: _samples)
+    {
+        auto summary = summarize(item.second);
+        const std::pair<const char*, double> values[] = {{"min", summary.min},
+            {"mean", summary.mean}, {"p50", summary.p50}, {"p90", summary.p90},
+            {"p99", summary.p99}, {"max", summary.max}};
+
+        if (_json)
+        {
+            _ofs << (first ? "\n" : ",\n") << "    \"" << escapeJson(item.first)
+                 << "\": {\"count\": " << summary.count;
+            for (auto& value: values)
+            {
+                _ofs << ", \"" << value.first << "\": " << value.second;
+            }
+            _ofs << "}";
+        }
+        else
+        {
+            // summary rows use statistic name as frame
+            for (auto& value: values)
+            {
+                _ofs << value.first << "," << item.first << "," << value.second << "\n";
+            }
+        }
+
+        OSG_NOTICE << std::left << std::setw(24) << item.first << " min " << summary.min
+                   << " p50 " << summary.p50 << " p99 " << summary.p99 << " max "
+                   << summary.max << " ms" << std::endl;
+        first = false;
+    }
+
+    if (_json)
+    {
+        _ofs << "\n  }\n}\n";
+    }
+    _ofs.flush();
+}
+
+}  // namespace toy
@@ -0,0 +1,182 @@
+#include <LateLatch.h>
+
+#include <functional>
+
+#include <osg/GLExtensions>
+#include <osg/GraphicsContext>
+#include <osg/Program>
+#include <osg/State>
+#include <osg/Uniform>
+
+#include <OsgFactory.h>
+#include <ToyBuiltins.h>
+
+#ifdef NTOY_X11
+// Xlib macros leak, keep it last.
+#    include <osgViewer/api/X11/GraphicsWindowX11>
+#endif
+
+namespace ntoy
+{
+
+namespace
+{
+
+// weight of the newest sample
+const double smoothing = 0.1;
+
+class PresentCallback : public osg::GraphicsContext::SwapCallback
+{
+public:
+    PresentCallback(
+        osg::GraphicsContext::SwapCallback* previous, std::function<void()> func)
+        : _previous(previous), _func(func)
+    {
+    }
+
+    void swapBuffersImplementation(osg::GraphicsContext* gc) override
+    {
+        if (_previous)
+        {
+            _previous->swapBuffersImplementation(gc);
+        }
+        else
+        {
+            gc->swapBuffersImplementation();
+        }
+        _func();
+    }
+
+private:
+    osg::ref_ptr<osg::GraphicsContext::SwapCallback> _previous;
+    std::function<void()> _func;
+};
+
+void smooth(double& average, double sample, unsigned samples)
+{
+    average = samples == 0 ? sample : average + (sample - average) * smoothing;
+}
+
+}  // namespace
+
+LateLatch::LateLatch(ToyBuiltins& builtins) : _builtins(builtins)
+{
+    _latchDrawable = osgf::createDrawable(
+        [this](osg::RenderInfo& renderInfo, const osg::Drawable*) {
+            latch(*renderInfo.getState());
+        });
+    _latchDrawable->setName("LateLatch");
+    _latchDrawable->setUseDisplayList(false);
+    _latchDrawable->setCullingActive(false);
+}
+
+void LateLatch::setGraphicsContext(osg::GraphicsContext* gc)
+{
+    _gc = gc;
+    gc->setSwapCallback(
+        new PresentCallback(gc->getSwapCallback(), [this]() { present(); }));
+
+#ifdef NTOY_X11
+    auto window = dynamic_cast<osgViewer::GraphicsWindowX11*>(gc);
+    if (window && window->getDisplay())
+    {
+        _display = window->getDisplay();
+        _window = window->getWindow();
+    }
+#endif
+}
+
+void LateLatch::setPointer(const osg::Vec2& pointer, osg::Timer_t tick)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pointer = pointer;
+    _pointerTick = tick;
+}
+
+LateLatch::Latency LateLatch::getLatency() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _latency;
+}
+
+void LateLatch::latch(osg::State& state)
+{
+    osg::Vec2 pointer;
+    osg::Timer_t tick = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        pointer = _pointer;
+        tick = _pointerTick;
+    }
+
+    auto now = osg::Timer::instance()->tick();
+
+#ifdef NTOY_X11
+    if (_display)
+    {
+        ::Window root, child;
+        int rootX, rootY, x, y;
+        unsigned mask;
+        auto display = static_cast<Display*>(_display);
+        auto height = _gc->getTraits()->height;
+        if (XQueryPointer(display, _window, &root, &child, &rootX, &rootY, &x, &y, &mask) &&
+            x >= 0 && y >= 0 && x < _gc->getTraits()->width && y < height)
+        {
+            // newer than any event if it differs. Its own time is unknown, age is still
+            // measured from the last delivered event, not from now.
+            osg::Vec2 queried(x, height - y);
+            if (queried != pointer)
+            {
+                pointer = queried;
+            }
+        }
+    }
+#endif
+
+    // update might have written an older pointer, always overwrite it.
+    _builtins.latchMouse(state, pointer);
+
+    // mouse uniform of the applied program, if it has one
+    auto pcp = state.getLastAppliedProgramObject();
+    if (pcp)
+    {
+        auto location = pcp->getUniformLocation(osg::Uniform::getNameID("mouse"));
+        if (location >= 0)
+        {
+            auto scale = _builtins.getMouseScale();
+            state.get<osg::GLExtensions>()->glUniform2f(
+                location, pointer.x() * scale, pointer.y() * scale);
+        }
+    }
+
+    // only new input is measured, there's no event to measure from before the first one.
+    if (pointer == _latchedPointer || tick == 0)
+    {
+        return;
+    }
+
+    _latchedPointer = pointer;
+    _latchedTick = tick;
+    _newInput = true;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    smooth(_latency.inputToDraw, osg::Timer::instance()->delta_m(tick, now),
+        _latency.samples);
+}
+
+void LateLatch::present()
+{
+    if (!_newInput)
+    {
+        return;
+    }
+    _newInput = false;
+
+    auto now = osg::Timer::instance()->tick();
+    std::lock_guard<std::mutex> lock(_mutex);
+    smooth(_latency.inputToPresent, osg::Timer::instance()->delta_m(_latchedTick, now),
+        _latency.samples);
+    ++_latency.samples;
+}
+
+}  // namespace ntoy
@@ -0,0 +1,241 @@
+#include <MinMaxPyramid.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <osg/Vec3i>
+
+#ifndef GL_RG32F
+#    define GL_RG32F 0x8230
+#endif
+
+namespace ntoy
+{
+
+namespace
+{
+
+auto includeSource = R"0(#pragma once
+// Min and max of the cell of pyramid that contains voxel at level. cellSize is
+// toy_MinMaxCellN of the pyramid.
+vec2 toy_MinMax(sampler3D pyramid, float cellSize, vec3 voxel, int level)
+{
+    ivec3 size = textureSize(pyramid, level);
+    ivec3 cell = ivec3(floor(voxel / (cellSize * exp2(float(level)))));
+    return texelFetch(pyramid, clamp(cell, ivec3(0), size - 1), level).rg;
+}
+
+// Distance along dir from voxel to where it leaves its cell at level, in voxels. Step a bit
+// further to land in the next cell.
+float toy_MinMaxExit(float cellSize, vec3 voxel, vec3 dir, int level)
+{
+    float size = cellSize * exp2(float(level));
+    vec3 lo = floor(voxel / size) * size;
+    vec3 t = (mix(lo, lo + size, step(0.0, dir)) - voxel) / dir;
+    return min(t.x, min(t.y, t.z));
+}
+)0";
+
+// First component of row y of slice z.
+template<typename T>
+void readRow(const osg::Image& image, int y, int z, float scale, std::vector<float>& row)
+{
+    auto components = osg::Image::computeNumComponents(image.getPixelFormat());
+    auto src = reinterpret_cast<const T*>(image.data(0, y, z));
+    for (auto x = 0; x < image.s(); ++x)
+    {
+        row[x] = src[x * components] * scale;
+    }
+}
+
+// Cells of level 0 that contain voxel i, the first voxel of a cell is also in the previous
+// one.
+std::pair<int, int> getCells(int i, int cellSize)
+{
+    auto cell = i / cellSize;
+    return std::make_pair(i % cellSize == 0 && cell > 0 ? cell - 1 : cell, cell);
+}
+
+// Each dst cell merges 2x2x2 src cells, the last one also merges the rest of an odd size.
+std::vector<float> downsample(
+    const std::vector<float>& src, const osg::Vec3i& srcSize, const osg::Vec3i& dstSize)
+{
+    auto range = [](int i, int srcSize, int dstSize) {
+        auto end = i == dstSize - 1 ? srcSize : std::min(2 * i + 2, srcSize);
+        return std::make_pair(2 * i, end);
+    };
+
+    std::vector<float> dst;
+    dst.reserve(dstSize.x() * dstSize.y() * dstSize.z() * 2);
+    for (auto z = 0; z < dstSize.z(); ++z)
+    {
+        auto zr = range(z, srcSize.z(), dstSize.z());
+        for (auto y = 0; y < dstSize.y(); ++y)
+        {
+            auto yr = range(y, srcSize.y(), dstSize.y());
+            for (auto x = 0; x < dstSize.x(); ++x)
+            {
+                auto xr = range(x, srcSize.x(), dstSize.x());
+                auto lo = std::numeric_limits<float>::max();
+                auto hi = std::numeric_limits<float>::lowest();
+                for (auto sz = zr.first; sz < zr.second; ++sz)
+                {
+                    for (auto sy = yr.first; sy < yr.second; ++sy)
+                    {
+                        auto cell = &src[((sz * srcSize.y() + sy) * srcSize.x()) * 2];
+                        for (auto sx = xr.first; sx < xr.second; ++sx)
+                        {
+                            lo = std::min(lo, cell[sx * 2]);
+                            hi = std::max(hi, cell[sx * 2 + 1]);
+                        }
+                    }
+                }
+                dst.push_back(lo);
+                dst.push_back(hi);
+            }
+        }
+    }
+    return dst;
+}
+
+}  // namespace
+
+osg::Image* createMinMaxPyramid(const osg::Image& volume, int cellSize)
+{
+    auto type = volume.getDataType();
+    if (volume.isCompressed() || cellSize <= 0 ||
+        (type != GL_UNSIGNED_BYTE && type != GL_UNSIGNED_SHORT && type != GL_FLOAT))
+    {
+        return 0;
+    }
+
+    osg::Vec3i size(volume.s(), volume.t(), volume.r());
+    osg::Vec3i cells((size.x() + cellSize - 1) / cellSize,
+        (size.y() + cellSize - 1) / cellSize, (size.z() + cellSize - 1) / cellSize);
+
+    std::vector<std::vector<float>> levels(1);
+    auto& level0 = levels.front();
+    level0.resize(cells.x() * cells.y() * cells.z() * 2);
+    for (auto i = 0u; i < level0.size(); i += 2)
+    {
+        level0[i] = std::numeric_limits<float>::max();
+        level0[i + 1] = std::numeric_limits<float>::lowest();
+    }
+
+    // reduce each row into cells along x, then merge it into every cell it's in.
+    std::vector<float> row(size.x());
+    std::vector<float> rowMinMax(cells.x() * 2);
+    for (auto z = 0; z < size.z(); ++z)
+    {
+        auto zc = getCells(z, cellSize);
+        for (auto y = 0; y < size.y(); ++y)
+        {
+            if (type == GL_UNSIGNED_BYTE)
+            {
+                readRow<unsigned char>(volume, y, z, 1.0f / 255, row);
+            }
+            else if (type == GL_UNSIGNED_SHORT)
+            {
+                readRow<unsigned short>(volume, y, z, 1.0f / 65535, row);
+            }
+            else
+            {
+                readRow<float>(volume, y, z, 1.0f, row);
+            }
+
+            for (auto cx = 0; cx < cells.x(); ++cx)
+            {
+                auto end = std::min((cx + 1) * cellSize + 1, size.x());
+                auto lo = row[cx * cellSize];
+                auto hi = lo;
+                for (auto x = cx * cellSize + 1; x < end; ++x)
+                {
+                    lo = std::min(lo, row[x]);
+                    hi = std::max(hi, row[x]);
+                }
+                rowMinMax[cx * 2] = lo;
+                rowMinMax[cx * 2 + 1] = hi;
+            }
+
+            auto yc = getCells(y, cellSize);
+            for (auto cz = zc.first; cz <= zc.second; ++cz)
+            {
+                for (auto cy = yc.first; cy <= yc.second; ++cy)
+                {
+                    auto cell = &level0[((cz * cells.y() + cy) * cells.x()) * 2];
+                    for (auto cx = 0; cx < cells.x() * 2; cx += 2)
+                    {
+                        cell[cx] = std::min(cell[cx], rowMinMax[cx]);
+                        cell[cx + 1] = std::max(cell[cx + 1], rowMinMax[cx + 1]);
+                    }
+                }
+            }
+        }
+    }
+
+    // mip sizes as gl computes them.
+    std::vector<osg::Vec3i> sizes{cells};
+    while (sizes.back() != osg::Vec3i(1, 1, 1))
+    {
+        auto& last = sizes.back();
+        osg::Vec3i next(std::max(1, last.x() / 2), std::max(1, last.y() / 2),
+            std::max(1, last.z() / 2));
+        levels.push_back(downsample(levels.back(), last, next));
+        sizes.push_back(next);
+    }
+
+    std::size_t totalSize = 0;
+    osg::Image::MipmapDataType offsets;
+    for (auto& level: levels)
+    {
+        if (totalSize > 0)
+        {
+            offsets.push_back(totalSize);
+        }
+        totalSize += level.size() * sizeof(float);
+    }
+
+    auto data = new unsigned char[totalSize];
+    auto dst = data;
+    for (auto& level: levels)
+    {
+        std::memcpy(dst, level.data(), level.size() * sizeof(float));
+        dst += level.size() * sizeof(float);
+    }
+
+    auto image = new osg::Image;
+    image->setImage(cells.x(), cells.y(), cells.z(), GL_RG32F, GL_RG, GL_FLOAT, data,
+        osg::Image::USE_NEW_DELETE, 1);
+    image->setMipmapLevels(offsets);
+    return image;
+}
+
+osg::Image* getMinMaxPlaceholder()
+{
+    static osg::ref_ptr<osg::Image> image;
+    if (!image)
+    {
+        image = new osg::Image;
+        image->allocateImage(1, 1, 1, GL_RG, GL_FLOAT, 1);
+        image->setInternalTextureFormat(GL_RG32F);
+        auto data = reinterpret_cast<float*>(image->data());
+        data[0] = std::numeric_limits<float>::lowest();
+        data[1] = std::numeric_limits<float>::max();
+    }
+    return image;
+}
+
+const char* getMinMaxIncludeName()
+{
+    return "ntoy/min_max.glsl";
+}
+
+const char* getMinMaxIncludeSource()
+{
+    return includeSource;
+}
+
+}  // namespace ntoy
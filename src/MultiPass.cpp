@@ -0,0 +1,286 @@
+#include <MultiPass.h>
+
+#include <osgDB/FileNameUtils>
+#include <osgDB/FileUtils>
+
+#include <BackgroundCompiler.h>
+#include <OsgFactory.h>
+#include <RenderTargetPool.h>
+#include <ShaderLibrary.h>
+#include <ToyBuiltins.h>
+
+namespace ntoy
+{
+
+namespace
+{
+
+std::string getBufferName(int index)
+{
+    return std::string(1, static_cast<char>('A' + index));
+}
+
+}  // namespace
+
+MultiPass::MultiPass(
+    ShaderLibrary& library, BackgroundCompiler& compiler, RenderTargetPool& pool)
+    : _library(library), _compiler(compiler), _pool(pool)
+{
+}
+
+bool MultiPass::addBuffer(const std::string& buffer, const std::string& file)
+{
+    if (buffer.size() != 1 || buffer[0] < 'A' || buffer[0] >= 'A' + numBuffers)
+    {
+        OSG_WARN << "Invalid buffer " << buffer << ", it must be A, B, C or D."
+                 << std::endl;
+        return false;
+    }
+
+    auto path = osgDB::findDataFile(file);
+    if (path.empty())
+    {
+        OSG_WARN << file << " not found in OSG_FILE_PATH" << std::endl;
+        return false;
+    }
+    // library keys included files by real path too.
+    path = osgDB::getRealPath(path);
+
+    auto& pass = _passes[buffer[0] - 'A'];
+    try
+    {
+        pass.source = _library.getSource(path);
+        pass.file = path;
+        return true;
+    }
+    catch (const ShaderIncludeError& e)
+    {
+        OSG_WARN << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool MultiPass::empty() const
+{
+    for (auto& pass: _passes)
+    {
+        if (!pass.file.empty())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void MultiPass::setup(
+    osg::Group* parent, const std::string& vertexSource, int width, int height)
+{
+    _parent = parent;
+    _width = width;
+    _height = height;
+    _vertex = new osg::Shader(osg::Shader::VERTEX, vertexSource);
+
+    auto parentSS = parent->getOrCreateStateSet();
+    for (auto i = 0; i < numBuffers; ++i)
+    {
+        parentSS->addUniform(new osg::Uniform(
+            ("toy_Buffer" + getBufferName(i)).c_str(), static_cast<int>(firstUnit + i)));
+
+        auto& pass = _passes[i];
+        if (pass.file.empty())
+        {
+            continue;
+        }
+
+        pass.program = createProgram(pass);
+        pass.group = new osg::Group;
+        pass.group->setName("Buffer" + getBufferName(i));
+        pass.group->getOrCreateStateSet()->setAttributeAndModes(pass.program);
+        parent->addChild(pass.group);
+
+        for (auto parity = 0; parity < 2; ++parity)
+        {
+            auto camera = osgf::createRttCamera(
+                0, 0, width, height, osg::Camera::FRAME_BUFFER_OBJECT);
+            camera->setName(pass.group->getName() + std::to_string(parity));
+            camera->setRenderOrder(osg::Camera::PRE_RENDER, i);
+            camera->setImplicitBufferAttachmentMask(0, 0);
+            camera->getOrCreateStateSet()->setDataVariance(osg::Object::DYNAMIC);
+            camera->addChild(osgf::getNdcQuad());
+            pass.group->addChild(camera);
+            pass.cameras[parity] = camera;
+        }
+    }
+    parentSS->setDataVariance(osg::Object::DYNAMIC);
+
+    allocateTargets();
+    update(0);
+}
+
+void MultiPass::resize(int width, int height)
+{
+    if (!_parent || (width == _width && height == _height))
+    {
+        return;
+    }
+
+    _width = width;
+    _height = height;
+    // old size is never used again
+    releaseTargets();
+    _pool.trim();
+    allocateTargets();
+}
+
+void MultiPass::reload(const FileSet& files, const osg::StateSet* defines)
+{
+    for (auto i = 0; i < numBuffers; ++i)
+    {
+        auto& pass = _passes[i];
+        if (!_parent || pass.file.empty() || !files.count(pass.file))
+        {
+            continue;
+        }
+
+        try
+        {
+            auto& source = _library.getSource(pass.file);
+            if (source == pass.source)
+            {
+                continue;
+            }
+            pass.source = source;
+        }
+        catch (const ShaderIncludeError& e)
+        {
+            OSG_WARN << e.what() << ", keep current source of " << pass.file << std::endl;
+            continue;
+        }
+
+        OSG_NOTICE << "Reload buffer " << getBufferName(i) << " " << pass.file << std::endl;
+        pass.pendingProgram = createProgram(pass);
+        _compiler.compile(pass.pendingProgram, defines,
+            [this, i](osg::Program* program, bool linked) {
+                auto& pass = _passes[i];
+                // superseded by a newer one
+                if (program != pass.pendingProgram)
+                {
+                    return;
+                }
+                pass.pendingProgram = 0;
+
+                if (!linked)
+                {
+                    OSG_WARN << "Failed to link buffer " << getBufferName(i)
+                             << ", keep current program." << std::endl;
+                    _library.logFileIndices();
+                    return;
+                }
+
+                pass.program = program;
+                pass.group->getStateSet()->setAttributeAndModes(program);
+                if (_swapCallback)
+                {
+                    _swapCallback();
+                }
+            });
+    }
+}
+
+void MultiPass::update(unsigned frameNumber)
+{
+    if (!_parent)
+    {
+        return;
+    }
+
+    auto parity = frameNumber % 2;
+    auto parentSS = _parent->getStateSet();
+    for (auto i = 0; i < numBuffers; ++i)
+    {
+        auto& pass = _passes[i];
+        if (pass.file.empty())
+        {
+            continue;
+        }
+
+        pass.cameras[parity]->setNodeMask(~0u);
+        pass.cameras[1 - parity]->setNodeMask(0);
+        parentSS->setTextureAttribute(firstUnit + i, pass.textures[parity]);
+    }
+}
+
+osg::Program* MultiPass::createProgram(const Pass& pass)
+{
+    auto program = new osg::Program;
+    program->addShader(_vertex);
+
+    auto frag = new osg::Shader(osg::Shader::FRAGMENT, pass.source);
+    frag->setFileName(pass.file);
+    program->addShader(frag);
+
+    ToyBuiltins::bindProgram(*program);
+    return program;
+}
+
+void MultiPass::allocateTargets()
+{
+    for (auto& pass: _passes)
+    {
+        if (pass.file.empty())
+        {
+            continue;
+        }
+
+        for (auto parity = 0; parity < 2; ++parity)
+        {
+            pass.textures[parity] = _pool.acquire(_width, _height, GL_RGBA32F_ARB);
+            auto camera = pass.cameras[parity];
+            camera->setViewport(0, 0, _width, _height);
+            camera->attach(osg::Camera::COLOR_BUFFER0, pass.textures[parity]);
+            camera->dirtyAttachmentMap();
+        }
+    }
+    OSG_NOTICE << "Buffer targets use " << _pool.getBytes() / 1048576.0 << " MiB, peak "
+               << _pool.getPeakBytes() / 1048576.0 << " MiB." << std::endl;
+
+    // earlier passes are read from this frame, others from last frame.
+    for (auto i = 0; i < numBuffers; ++i)
+    {
+        if (_passes[i].file.empty())
+        {
+            continue;
+        }
+
+        for (auto parity = 0; parity < 2; ++parity)
+        {
+            auto ss = _passes[i].cameras[parity]->getStateSet();
+            for (auto j = 0; j < numBuffers; ++j)
+            {
+                auto& input = _passes[j];
+                if (!input.file.empty())
+                {
+                    ss->setTextureAttribute(firstUnit + j,
+                        input.textures[j < i ? parity : 1 - parity]);
+                }
+            }
+        }
+    }
+}
+
+void MultiPass::releaseTargets()
+{
+    for (auto& pass: _passes)
+    {
+        for (auto& texture: pass.textures)
+        {
+            if (texture)
+            {
+                _pool.release(texture);
+                texture = 0;
+            }
+        }
+    }
+}
+
+}  // namespace ntoy
@@ -15,10 +15,12 @@
 #include <osgDB/ReadFile>
 #include <osgDB/WriteFile>
 #include <osgGA/OrbitManipulator>
+#include <osgText/Text>
 #include <osgViewer/Viewer>
 #include <osg/ShapeDrawable>
 
 #include <cassert>
+#include <MinMaxPyramid.h>
 #include <OsgFactory.h>
 #include <OsgQuery.h>
 #include <Resource.h>
@@ -38,24 +40,19 @@ void main( void )
     gl_Position = gl_Vertex;
 })0";
 
-auto toyFragSource = R"0(#version 120
+auto toyFragHeader = R"0(#version 140
 
 #define PI 3.1415926535897932384626433832795
 #define PI_2 ( PI * 0.5 )
 #define PI_4 ( PI * 0.25 )
 #define PI_8 ( PI * 0.125 )
 
-uniform int osg_FrameNumber;
-uniform float osg_FrameTime;
-uniform float osg_DeltaFrameTime;
-uniform float osg_SimulationTime;
-uniform float osg_DeltaSimulationTime;
-uniform vec2 mouse;
-uniform vec2 resolution;
+)0";
 
+auto toyFragMain = R"0(
 void main( void )
 {
-    vec2 st = gl_FragCoord.xy / resolution;
+    vec2 st = gl_FragCoord.xy * toy_Resolution.zw;
     gl_FragColor = vec4(st, 0, 1);
 })0";
 
@@ -76,6 +73,25 @@ bool addResource(osg::ArgumentParser& parser, const std::string& option,
     }
 }
 
+osg::Shader::Type getShaderType(const std::string& file)
+{
+    auto ext = osgDB::getLowerCaseFileExtension(file);
+    if (ext == "vert" || ext == "vs")
+        return osg::Shader::VERTEX;
+    if (ext == "frag" || ext == "fs")
+        return osg::Shader::FRAGMENT;
+    if (ext == "geom" || ext == "gs")
+        return osg::Shader::GEOMETRY;
+    if (ext == "tesc" || ext == "tctrl")
+        return osg::Shader::TESSCONTROL;
+    if (ext == "tese" || ext == "teval")
+        return osg::Shader::TESSEVALUATION;
+    if (ext == "comp" || ext == "cs")
+        return osg::Shader::COMPUTE;
+
+    return osg::Shader::UNDEFINED;
+}
+
 osg::Texture::FilterMode stringToFilterMode(const std::string& s);
 std::string filterModeToString(osg::Texture::FilterMode mode);
 
@@ -254,22 +270,52 @@ NodeToy::NodeToy(osg::ArgumentParser& args, osgViewer::Viewer* viewer) : _viewer
 {
     createScene();
 
+    _shaderLibrary.addBuiltin(
+        BrickedVolume::getIncludeName(), BrickedVolume::getIncludeSource());
+    _shaderLibrary.addBuiltin(getMinMaxIncludeName(), getMinMaxIncludeSource());
+
+    _nodeReader.setFinishedCallback([this]() {
+        if (_wakeCallback)
+        {
+            _wakeCallback(0);
+        }
+    });
+
+    readReloadOptions(args);
+
     // If exporting textures, create program, ignore all other options.
     std::string script;
     _exportTextures = args.read("--export-texture", script);
     if (_exportTextures)
     {
-        readExportTextures(script);
+        readExportTextures(args, script);
         _viewer->setThreadingModel(osgViewer::Viewer::SingleThreaded);
         return;
     }
 
+    if (args.read("--screenshot", _screenshotFile))
+    {
+        _viewer->setThreadingModel(osgViewer::Viewer::SingleThreaded);
+    }
+
+    if (args.read("--no-program-cache"))
+    {
+        _programCache.setDirectory("");
+    }
+
+    readTexturePack(args);
+
     bool shadertoy = args.find("--shadertoy") != -1;
     bool needProgram = shadertoy;
     needProgram |= readShaders(args);
 
     if (needProgram)
     {
+        // shadertoy falls back to the default frag if --frag failed.
+        if (!_program)
+        {
+            _program = new osg::Program;
+        }
         setupProgram();
     }
 
@@ -277,27 +323,90 @@ NodeToy::NodeToy(osg::ArgumentParser& args, osgViewer::Viewer* viewer) : _viewer
 
     readDefines(args);
 
+    readVariants(args);
+
     if (shadertoy)
     {
         createShadertoyNode();
+        readAccumulation(args);
+        readDynamicResolution(args);
+        readBuffers(args);
     }
     else
     {
         readNode(args);
     }
+
+    if (_program)
+    {
+        applyProgramCache();
+        _sceneRoot->addChild(_programCache.getRecorder());
+        _sceneRoot->addChild(_compiler.getFallbackCompiler());
+        _compiler.setGraphicsContext(_viewer->getCamera()->getGraphicsContext());
+        compileVariants();
+    }
+}
+
+bool NodeToy::brickVolume(osg::ArgumentParser& args)
+{
+    std::string raw;
+    osg::Vec3i size;
+    std::string pixelFormat;
+    std::string pixelType;
+    std::string file;
+    if (!args.read("--brick-volume", raw, size.x(), size.y(), size.z(), pixelFormat,
+            pixelType, file))
+    {
+        OSG_FATAL << "--brick-volume needs raw width height depth pixel_format pixel_type "
+                     "output"
+                  << std::endl;
+        return false;
+    }
+
+    auto brickSize = 32;
+    args.read("--brick-size", brickSize);
+
+    try
+    {
+        BrickedVolume::convert(raw, size, stringToPixelFormat(pixelFormat),
+            stringToPixelType(pixelType), file, brickSize);
+    }
+    catch (const std::runtime_error& e)
+    {
+        OSG_FATAL << "Failed to brick " << raw << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    OSG_NOTICE << "Wrote " << file << std::endl;
+    return true;
 }
 
 void NodeToy::reloadNode(const std::string& file)
 {
-    _sceneRoot->removeChild(0, _sceneRoot->getNumChildren());
+    _nodeReader.request(file);
+}
+
+void NodeToy::updateNode()
+{
+    std::string file;
+    osg::ref_ptr<osg::Node> node;
+    if (!_nodeReader.takeResult(file, node))
+    {
+        return;
+    }
 
-    _node = osgDB::readNodeFile(file);
-    if (!_node)
+    if (!node)
     {
-        OSG_WARN << "Failed to read node from " << file << std::endl;
+        OSG_WARN << "Failed to read node from " << file << ", keep current one."
+                 << std::endl;
         return;
     }
 
+    if (_node)
+    {
+        _sceneRoot->removeChild(_node);
+    }
+    _node = node.get();
     _sceneRoot->addChild(_node);
 
     // zoom camera, always focus at origin.
@@ -368,29 +477,126 @@ void NodeToy::toggleAxes()
     }
 }
 
-void NodeToy::exportTextures()
+void NodeToy::toggleLatencyOverlay()
 {
-    for (auto& et: _exportTextureList)
+    if (_latencyOverlay)
     {
-        OSG_NOTICE << "Writing " << et.img->s() << "x" << et.img->t() << " "
-                   << et.output_name << " with frag " << et.frag << std::endl;
-        osgDB::writeImageFile(*et.img, et.output_name);
+        _latencyOverlay->setNodeMask(!_latencyOverlay->getNodeMask());
+        return;
     }
+
+    auto rect = osgq::getWindowRect(*_viewer);
+    _latencyOverlay = osgf::createOrthoCamera(0, rect.z(), 0, rect.w());
+    _latencyOverlay->setName("LatencyOverlay");
+    _latencyOverlay->setRenderOrder(osg::Camera::POST_RENDER);
+    _latencyOverlay->setAllowEventFocus(false);
+    auto ss = _latencyOverlay->getOrCreateStateSet();
+    ss->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+    ss->setMode(GL_DEPTH_TEST, osg::StateAttribute::OFF);
+
+    _latencyText = new osgText::Text;
+    _latencyText->setDataVariance(osg::Object::DYNAMIC);
+    _latencyText->setCharacterSize(16);
+    _latencyText->setPosition(osg::Vec3(8, 8, 0));
+    _latencyText->setAlignment(osgText::Text::LEFT_BOTTOM);
+    _latencyText->setText("No mouse input yet.");
+    _latencyOverlay->addChild(_latencyText);
+
+    _root->addChild(_latencyOverlay);
+}
+
+bool NodeToy::exportTextures()
+{
+    return !_textureExporter || _textureExporter->update();
+}
+
+bool NodeToy::needsFrame() const
+{
+    return (_accumulator.isEnabled() && !_accumulator.isConverged()) || _exportTextures ||
+           !_screenshotFile.empty() || !isSceneReady();
 }
 
-void NodeToy::updateMouse(const osg::Vec2& mouse)
+void NodeToy::poll()
 {
-    if (_mouseUniform)
+    _observer->poll();
+    _compiler.update();
+    requestReloadFrame();
+}
+
+bool NodeToy::isSceneReady() const
+{
+    // node file is observed, it's requested after the first update.
+    return _viewer->getFrameStamp()->getFrameNumber() >= 2 && _nodeReader.isIdle() &&
+           _textureLoader.isIdle() && _brickedVolume.isIdle() && _texturePack.isIdle();
+}
+
+bool NodeToy::screenshot()
+{
+    if (_screenshotImage)
     {
-        _mouseUniform->set(mouse);
+        if (osgDB::writeImageFile(*_screenshotImage, _screenshotFile))
+        {
+            OSG_NOTICE << "Write screenshot " << _screenshotFile << std::endl;
+        }
+        else
+        {
+            OSG_FATAL << "Failed to write screenshot " << _screenshotFile << std::endl;
+        }
+        _screenshotImage = 0;
+        _screenshotFile.clear();
+        return true;
+    }
+
+    if (_screenshotRequested || !isSceneReady())
+    {
+        return false;
     }
+
+    _screenshotRequested = true;
+    auto camera = _viewer->getCamera();
+    camera->setFinalDrawCallback(static_cast<osg::Camera::DrawCallback*>(
+        osgf::createDrawCallback([this, camera](osg::RenderInfo&) {
+            if (_screenshotImage || _screenshotFile.empty())
+            {
+                return;
+            }
+
+            auto viewport = camera->getViewport();
+            _screenshotImage = new osg::Image;
+            _screenshotImage->readPixels(viewport->x(), viewport->y(), viewport->width(),
+                viewport->height(), GL_RGB, GL_UNSIGNED_BYTE);
+        })));
+    return false;
+}
+
+void NodeToy::updateMouse(const osg::Vec2& mouse, double eventTime)
+{
+    _builtins.setMouse(mouse);
+
+    auto ticks = static_cast<osg::Timer_t>(
+        eventTime / osg::Timer::instance()->getSecondsPerTick());
+    _lateLatch.setPointer(mouse, _viewer->getStartTick() + ticks);
+}
+
+void NodeToy::clickMouse(const osg::Vec2& mouse)
+{
+    _builtins.setMouseClick(mouse);
 }
 
 void NodeToy::updateResolution(const osg::Vec2& resolution)
 {
-    if (_resolutionUniform)
+    // scaled resolution is set in update
+    if (!_dynamicResolution.isEnabled())
+    {
+        _builtins.setResolution(resolution);
+    }
+    _dynamicResolution.resize(resolution.x(), resolution.y());
+    _multiPass.resize(resolution.x(), resolution.y());
+    _accumulator.resize(resolution.x(), resolution.y());
+
+    if (_latencyOverlay)
     {
-        _resolutionUniform->set(resolution);
+        _latencyOverlay->setProjectionMatrixAsOrtho2D(0, resolution.x(), 0, resolution.y());
     }
 }
 
@@ -419,7 +625,7 @@ std::string NodeToy::createDefaultFrag()
     }
 
     // use predfined frag
-    ofs << toyFragSource;
+    ofs << toyFragHeader << ToyBuiltins::getBlockSource() << toyFragMain;
     return file;
 }
 
@@ -449,11 +655,262 @@ void NodeToy::createScene()
 
     _observer = new ResourceObserver;
     _root->addUpdateCallback(_observer);
+    _root->addUpdateCallback(osgf::createCallback(
+        [this](osg::Object*, osg::Object*) { requestReloadFrame(); }));
+    _root->addUpdateCallback(osgf::createCallback(
+        [this](osg::Object*, osg::Object*) { updateNode(); }));
+    _root->addUpdateCallback(osgf::createCallback([this](osg::Object*, osg::Object*) {
+        // samples of the placeholder or of the replaced texture must not stay in the mean.
+        if (_textureLoader.update())
+        {
+            _accumulator.reset();
+        }
+    }));
+    _root->addUpdateCallback(osgf::createCallback([this](osg::Object*, osg::Object*) {
+        if (_texturePack.update())
+        {
+            _accumulator.reset();
+        }
+    }));
+    _root->addUpdateCallback(osgf::createCallback([this](osg::Object*, osg::Object*) {
+        if (!_programCache.update())
+        {
+            _shaderLibrary.logFileIndices();
+        }
+    }));
+    _root->addUpdateCallback(osgf::createCallback(
+        [this](osg::Object*, osg::Object*) { _compiler.update(); }));
+    _root->addUpdateCallback(osgf::createCallback(
+        [this](osg::Object*, osg::Object*) { updateDynamicResolution(); }));
+    _root->addUpdateCallback(osgf::createCallback(
+        [this](osg::Object*, osg::Object*) { updateBuiltins(); }));
+    _root->addUpdateCallback(osgf::createCallback(
+        [this](osg::Object*, osg::Object*) { updateLatencyOverlay(); }));
+    _root->addUpdateCallback(osgf::createCallback([this](osg::Object*, osg::Object*) {
+        _multiPass.update(_viewer->getFrameStamp()->getFrameNumber());
+    }));
+    _root->addUpdateCallback(osgf::createCallback(
+        [this](osg::Object*, osg::Object*) { updateBrickedVolume(); }));
+    _root->addUpdateCallback(osgf::createCallback(
+        [this](osg::Object*, osg::Object*) { updateAccumulation(); }));
+
+    // relink once per burst of shader changes, any observed file restarts accumulation.
+    _observer->setBatchCallback([this](const FileSet& files) {
+        _accumulator.reset();
+        reloadShaders(files);
+    });
+    _multiPass.setSwapCallback([this]() {
+        _accumulator.reset();
+        _viewer->requestRedraw();
+    });
+}
+
+void NodeToy::requestReloadFrame()
+{
+    if (!_wakeCallback)
+    {
+        return;
+    }
+
+    auto& coalescer = _observer->getCoalescer();
+    auto now = osg::Timer::instance()->time_s();
+    auto settleTime = coalescer.getNextSettleTime();
+
+    // nothing wakes the viewer for stat polled files, poll them every quiet period.
+    if (settleTime < 0 && _observer->getFileWatcher()->hasPolledFiles())
+    {
+        settleTime = now + coalescer.getQuietPeriod();
+    }
+
+    // compile thread doesn't wake anyone, check it again shortly.
+    if (_compiler.hasPendingJobs() && (settleTime < 0 || settleTime > now + 0.01))
+    {
+        settleTime = now + 0.01;
+    }
+
+    if (settleTime >= 0)
+    {
+        _wakeCallback(std::max(0.0, settleTime - now));
+    }
+}
+
+void NodeToy::updateBuiltins()
+{
+    // uniforms are created by setupProgram, a failed shader option can leave _program
+    // without them.
+    if (!_mouseUniform || !_resolutionUniform)
+    {
+        return;
+    }
+
+    auto sceneSS = _sceneRoot->getStateSet();
+    for (auto unit = 0u; unit < 4; ++unit)
+    {
+        auto texture = dynamic_cast<osg::Texture*>(
+            sceneSS->getTextureAttribute(unit, osg::StateAttribute::TEXTURE));
+        auto image = texture && texture->getNumImages() > 0 ? texture->getImage(0) : 0;
+        osg::Vec3 resolution;
+        if (image)
+        {
+            resolution.set(image->s(), image->t(), image->r());
+        }
+        else if (texture)
+        {
+            resolution.set(texture->getTextureWidth(), texture->getTextureHeight(),
+                texture->getTextureDepth());
+        }
+        _builtins.setChannelResolution(unit, resolution);
+    }
+    _builtins.update(*_viewer->getFrameStamp());
+
+    // legacy uniforms, only dirtied if input changed since last frame.
+    osg::Vec2 v;
+    auto mouse = _builtins.getMouse() * _builtins.getMouseScale();
+    if (_mouseUniform->get(v) && v != mouse)
+    {
+        _mouseUniform->set(mouse);
+    }
+    if (_resolutionUniform->get(v) && v != _builtins.getResolution())
+    {
+        _resolutionUniform->set(_builtins.getResolution());
+    }
+}
+
+void NodeToy::updateAccumulation()
+{
+    if (!_accumulator.isEnabled())
+    {
+        return;
+    }
+
+    auto input = getFrameInput();
+    if (input != _accumulationInput)
+    {
+        _accumulationInput = input;
+        _accumulator.reset();
+    }
+    _accumulator.update();
+}
+
+void NodeToy::updateBrickedVolume()
+{
+    if (!_brickedVolume.isEnabled())
+    {
+        return;
+    }
+
+    // bricks touched by a new view or program are only known from feedback of new frames.
+    // Time is left out, it moves every unpaused frame and the volume would never be idle.
+    // Bricks an animation touches later are still loaded from feedback of those frames.
+    auto input = getFrameInput();
+    std::get<0>(input) = 0;
+    if (input != _brickInput)
+    {
+        _brickInput = input;
+        _brickedVolume.invalidate();
+    }
+
+    if (_brickedVolume.update())
+    {
+        _accumulator.reset();
+    }
+}
+
+NodeToy::FrameInput NodeToy::getFrameInput() const
+{
+    return std::make_tuple(_viewer->getFrameStamp()->getSimulationTime(),
+        _builtins.getMouse(), _builtins.getMouseClick(), _builtins.getResolution(),
+        _program, _viewer->getCamera()->getViewMatrix());
+}
+
+void NodeToy::updateDynamicResolution()
+{
+    if (!_dynamicResolution.isEnabled())
+    {
+        return;
+    }
+
+    _dynamicResolution.update();
+    _builtins.setResolution(_dynamicResolution.getRenderSize());
+    _builtins.setMouseScale(_dynamicResolution.getScale());
+}
+
+void NodeToy::updateLatencyOverlay()
+{
+    if (!_latencyOverlay || !_latencyOverlay->getNodeMask())
+    {
+        return;
+    }
+
+    // readable, not flickering
+    auto now = osg::Timer::instance()->time_s();
+    if (now - _latencyTextTime < 0.25)
+    {
+        return;
+    }
+    _latencyTextTime = now;
+
+    auto latency = _lateLatch.getLatency();
+    if (latency.samples == 0)
+    {
+        return;
+    }
+
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2) << "input to draw " << latency.inputToDraw
+       << " ms\ninput to present " << latency.inputToPresent << " ms";
+    _latencyText->setText(ss.str());
+}
+
+void NodeToy::readReloadOptions(osg::ArgumentParser& args)
+{
+    auto& coalescer = _observer->getCoalescer();
+
+    double delay = 0;
+    if (args.read("--reload-delay", delay))
+    {
+        coalescer.setQuietPeriod(delay * 0.001);
+    }
+
+    if (args.read("--reload-hash"))
+    {
+        coalescer.setHashContent(true);
+    }
 }
 
 void NodeToy::readTextures(osg::ArgumentParser& args)
 {
+    // images are decoded in background, textures show a placeholder until then. Changed
+    // images are streamed into new textures, the old ones are drawn until then.
     auto sceneSS = _sceneRoot->getOrCreateStateSet();
+    _sceneRoot->addChild(_textureLoader.getStreamDrawable());
+
+    auto load = [this, sceneSS](int unit, osg::Texture* texture, const std::string& file,
+                    int minMaxUnit) {
+        _textureLoader.load(sceneSS, unit, texture, file, minMaxUnit);
+        try
+        {
+            _observer->addResource(Resource(file,
+                [this, file](const std::string&) { _textureLoader.reload(file); }));
+        }
+        catch (const Resource::ResourceNotFoundError& e)
+        {
+            OSG_WARN << e.what() << ", it won't be reloaded." << std::endl;
+        }
+    };
+
+    // MiB
+    auto brickCache = 512.0;
+    args.read("--brick-cache", brickCache);
+
+    // pyramid of the 3d texture on unit n is bound to unit minMaxUnit + n.
+    auto minMaxUnit = -1;
+    args.read("--min-max-unit", minMaxUnit);
+    auto minMaxCell = 8;
+    if (args.read("--min-max-cell", minMaxCell))
+    {
+        _textureLoader.setMinMaxCellSize(minMaxCell);
+    }
 
     std::string textureFile;
     int textureUnit = 0;
@@ -464,23 +921,23 @@ void NodeToy::readTextures(osg::ArgumentParser& args)
     std::string wrapR;
     while (args.read("--texture3d", textureFile, minFilter, magFilter, wrapS, wrapT, wrapR))
     {
-        auto img = osgDB::readImageFile(textureFile);
-        if (!img)
-        {
-            OSG_WARN << "Failed to load " << img << std::endl;
-            continue;
-        }
-
         try
         {
-            auto texture = new osg::Texture3D(img);
+            if (osgDB::getLowerCaseFileExtension(textureFile) == "bvol")
+            {
+                readBrickedVolume(textureUnit++, textureFile, brickCache, magFilter);
+                continue;
+            }
+
+            auto texture = new osg::Texture3D;
             texture->setFilter(osg::Texture::MIN_FILTER, stringToFilterMode(minFilter));
             texture->setFilter(osg::Texture::MAG_FILTER, stringToFilterMode(magFilter));
             texture->setWrap(osg::Texture::WRAP_S, stringToWrapMode(wrapS));
             texture->setWrap(osg::Texture::WRAP_T, stringToWrapMode(wrapT));
             texture->setWrap(osg::Texture::WRAP_R, stringToWrapMode(wrapR));
 
-            sceneSS->setTextureAttributeAndModes(textureUnit++, texture);
+            auto pyramidUnit = minMaxUnit == -1 ? -1 : minMaxUnit + textureUnit;
+            load(textureUnit++, texture, textureFile, pyramidUnit);
         }
         catch (const std::runtime_error& e)
         {
@@ -491,22 +948,15 @@ void NodeToy::readTextures(osg::ArgumentParser& args)
     textureUnit = 0;
     while (args.read("--texture2d", textureFile, minFilter, magFilter, wrapS, wrapT))
     {
-        auto img = osgDB::readImageFile(textureFile);
-        if (!img)
-        {
-            OSG_WARN << "Failed to load " << img << std::endl;
-            continue;
-        }
-
         try
         {
-            auto texture = new osg::Texture2D(img);
+            auto texture = new osg::Texture2D;
             texture->setFilter(osg::Texture::MIN_FILTER, stringToFilterMode(minFilter));
             texture->setFilter(osg::Texture::MAG_FILTER, stringToFilterMode(magFilter));
             texture->setWrap(osg::Texture::WRAP_S, stringToWrapMode(wrapS));
             texture->setWrap(osg::Texture::WRAP_T, stringToWrapMode(wrapT));
 
-            sceneSS->setTextureAttributeAndModes(textureUnit++, texture);
+            load(textureUnit++, texture, textureFile, -1);
         }
         catch (const std::runtime_error& e)
         {
@@ -517,21 +967,14 @@ void NodeToy::readTextures(osg::ArgumentParser& args)
     textureUnit = 0;
     while (args.read("--texture1d", textureFile, minFilter, magFilter, wrapS))
     {
-        auto img = osgDB::readImageFile(textureFile);
-        if (!img)
-        {
-            OSG_WARN << "Failed to load " << img << std::endl;
-            continue;
-        }
-
         try
         {
-            auto texture = new osg::Texture1D(img);
+            auto texture = new osg::Texture1D;
             texture->setFilter(osg::Texture::MIN_FILTER, stringToFilterMode(minFilter));
             texture->setFilter(osg::Texture::MAG_FILTER, stringToFilterMode(magFilter));
             texture->setWrap(osg::Texture::WRAP_S, stringToWrapMode(wrapS));
 
-            sceneSS->setTextureAttributeAndModes(textureUnit++, texture);
+            load(textureUnit++, texture, textureFile, -1);
         }
         catch (const std::runtime_error& e)
         {
@@ -540,6 +983,77 @@ void NodeToy::readTextures(osg::ArgumentParser& args)
     }
 }
 
+void NodeToy::readTexturePack(osg::ArgumentParser& args)
+{
+    std::string file;
+    while (args.read("--texture2d-pack", file))
+    {
+        _texturePack.addFile(file);
+    }
+    if (!_texturePack.isEnabled())
+    {
+        return;
+    }
+
+    auto unit = 14;
+    args.read("--texture2d-pack-unit", unit);
+    std::string minFilter = "linear";
+    std::string magFilter = "linear";
+    args.read("--texture2d-pack-filter", minFilter, magFilter);
+
+    auto minMode = osg::Texture::LINEAR;
+    auto magMode = osg::Texture::LINEAR;
+    try
+    {
+        minMode = stringToFilterMode(minFilter);
+        magMode = stringToFilterMode(magFilter);
+    }
+    catch (const std::runtime_error& e)
+    {
+        OSG_WARN << e.what() << ", pack is filtered linear." << std::endl;
+    }
+
+    _shaderLibrary.addBuiltin(
+        TexturePack::getIncludeName(), _texturePack.getIncludeSource());
+    _texturePack.setup(_sceneRoot->getOrCreateStateSet(), unit, minMode, magMode);
+
+    // any changed image packs all of them again.
+    for (auto& packFile: _texturePack.getFiles())
+    {
+        try
+        {
+            _observer->addResource(
+                Resource(packFile, [this](const std::string&) { _texturePack.reload(); }));
+        }
+        catch (const Resource::ResourceNotFoundError& e)
+        {
+            OSG_WARN << e.what() << ", it won't be reloaded." << std::endl;
+        }
+    }
+}
+
+void NodeToy::readBrickedVolume(
+    int unit, const std::string& file, double cacheMiB, const std::string& filter)
+{
+    if (_brickedVolume.isEnabled())
+    {
+        OSG_WARN << "Only one bricked volume is supported, ignore " << file << std::endl;
+        return;
+    }
+
+    // bricks are filtered within their border, there are no mipmaps.
+    auto mode = stringToFilterMode(filter);
+    if (mode != osg::Texture::NEAREST)
+    {
+        mode = osg::Texture::LINEAR;
+    }
+
+    auto path = osgDB::findDataFile(file);
+    _brickedVolume.open(
+        path.empty() ? file : path, static_cast<std::size_t>(cacheMiB * 1048576));
+    _brickedVolume.setup(_sceneRoot, unit, mode);
+}
+
 bool NodeToy::readShaders(osg::ArgumentParser& args)
 {
     bool b = false;
@@ -547,15 +1061,15 @@ bool NodeToy::readShaders(osg::ArgumentParser& args)
     std::string file;
     while (args.read("--shader", file))
     {
-        b |= readShader(args, "--shader") != 0;
+        b |= createShader(file) != 0;
     }
 
-    b |= (_vert = readShader(args, "--vert")) != 0;
-    b |= (_geom = readShader(args, "--geom")) != 0;
-    b |= (_frag = readShader(args, "--frag")) != 0;
-    b |= (_tesc = readShader(args, "--tesc")) != 0;
-    b |= (_tese = readShader(args, "--tese")) != 0;
-    b |= (_comp = readShader(args, "--comp")) != 0;
+    b |= (_vert = readShader(args, "--vert", osg::Shader::VERTEX)) != 0;
+    b |= (_geom = readShader(args, "--geom", osg::Shader::GEOMETRY)) != 0;
+    b |= (_frag = readShader(args, "--frag", osg::Shader::FRAGMENT)) != 0;
+    b |= (_tesc = readShader(args, "--tesc", osg::Shader::TESSCONTROL)) != 0;
+    b |= (_tese = readShader(args, "--tese", osg::Shader::TESSEVALUATION)) != 0;
+    b |= (_comp = readShader(args, "--comp", osg::Shader::COMPUTE)) != 0;
 
     return b;
 }
@@ -563,46 +1077,248 @@ bool NodeToy::readShaders(osg::ArgumentParser& args)
 osg::Shader* NodeToy::readShader(
     osg::ArgumentParser& args, const std::string& option, int shaderType)
 {
-    if (!_program)
+    std::string file;
+    if (args.read(option, file))
     {
-        _program = new osg::Program;
+        return createShader(file, shaderType);
     }
 
-    std::string file;
-    if (args.read(option, file))
+    return 0;
+}
+
+osg::Shader* NodeToy::createShader(const std::string& file, int shaderType)
+{
+    auto path = osgDB::findDataFile(file);
+    if (path.empty())
+    {
+        OSG_WARN << file << " not found in OSG_FILE_PATH" << std::endl;
+        return 0;
+    }
+    // same key as included files, a file can be both.
+    path = osgDB::getRealPath(path);
+
+    auto type = shaderType == -1 ? getShaderType(path)
+                                 : static_cast<osg::Shader::Type>(shaderType);
+    if (type == osg::Shader::UNDEFINED)
     {
-        auto shader =
-            osgDB::readShaderFile(static_cast<osg::Shader::Type>(shaderType), file);
+        OSG_WARN << "Unknown shader type of " << path << std::endl;
+        return 0;
+    }
 
-        if (shader)
+    try
+    {
+        auto shader = new osg::Shader(type, _shaderLibrary.getSource(path));
+        shader->setFileName(path);
+        if (!_program)
         {
-            _observer->addResource(createShaderResource(shader));
-            _program->addShader(shader);
-            return shader;
+            _program = new osg::Program;
         }
+        _program->addShader(shader);
+        _shaders[path].push_back(shader);
+        observeShaderFiles();
+        return shader;
+    }
+    catch (const ShaderIncludeError& e)
+    {
+        OSG_WARN << e.what() << std::endl;
     }
 
     return 0;
 }
 
+void NodeToy::reloadShaders(const FileSet& files)
+{
+    FileSet invalidatedFiles;
+    for (auto& file: files)
+    {
+        if (_shaderLibrary.getFiles().count(file))
+        {
+            _shaderLibrary.invalidate(file, invalidatedFiles);
+        }
+    }
+
+    // expansion might find new includes, or new missing ones.
+    _multiPass.reload(invalidatedFiles, _sceneRoot->getStateSet());
+    observeShaderFiles();
+
+    if (!_program || invalidatedFiles.empty())
+    {
+        return;
+    }
+
+    // Build from current program with latest source of every shader, so a pending
+    // program is superseded without losing its changes.
+    osg::ref_ptr<osg::Program> program =
+        new osg::Program(*_program, osg::CopyOp::SHALLOW_COPY);
+    std::map<osg::Shader*, osg::Shader*> replacements;
+    for (auto& item: _shaders)
+    {
+        try
+        {
+            auto& source = _shaderLibrary.getSource(item.first);
+            for (auto shader: item.second)
+            {
+                if (shader->getShaderSource() == source)
+                {
+                    continue;
+                }
+
+                OSG_NOTICE << "Reload " << item.first << std::endl;
+                auto newShader = new osg::Shader(shader->getType(), source);
+                newShader->setFileName(item.first);
+                program->removeShader(shader);
+                program->addShader(newShader);
+                replacements[shader] = newShader;
+            }
+        }
+        catch (const ShaderIncludeError& e)
+        {
+            OSG_WARN << e.what() << ", keep current source of " << item.first << std::endl;
+        }
+    }
+    observeShaderFiles();
+
+    if (replacements.empty())
+    {
+        // back to current sources, whatever pending is outdated.
+        _pendingProgram = 0;
+        _pendingShaders.clear();
+        return;
+    }
+
+    _pendingShaders = replacements;
+    compileProgram(program);
+}
+
+void NodeToy::compileProgram(osg::Program* program)
+{
+    _pendingProgram = program;
+
+    auto defines = _sceneRoot->getStateSet();
+    _programCache.restore(program, defines);
+    _compiler.compile(program, defines, [this](osg::Program* program, bool linked) {
+        // superseded by a newer one
+        if (program != _pendingProgram)
+        {
+            return;
+        }
+
+        auto defines = _sceneRoot->getStateSet();
+        if (!linked && program->getProgramBinary())
+        {
+            _programCache.reject(*program, defines);
+            program->setProgramBinary(0);
+            program->dirtyProgram();
+            compileProgram(program);
+            return;
+        }
+
+        if (!linked)
+        {
+            OSG_WARN << "Failed to link program, keep current one." << std::endl;
+            _shaderLibrary.logFileIndices();
+            _pendingProgram = 0;
+            _pendingShaders.clear();
+            return;
+        }
+
+        swapProgram();
+    });
+}
+
+void NodeToy::swapProgram()
+{
+    for (auto& item: _shaders)
+    {
+        for (auto& shader: item.second)
+        {
+            auto iter = _pendingShaders.find(shader);
+            if (iter != _pendingShaders.end())
+            {
+                shader = iter->second;
+            }
+        }
+    }
+
+    for (auto shader: {&_vert, &_geom, &_frag, &_tesc, &_tese, &_comp})
+    {
+        auto iter = _pendingShaders.find(*shader);
+        if (iter != _pendingShaders.end())
+        {
+            *shader = iter->second;
+        }
+    }
+
+    _program = _pendingProgram.get();
+    _sceneRoot->getStateSet()->setAttributeAndModes(_program);
+    applyProgramCache();
+    OSG_NOTICE << "Swap in relinked program." << std::endl;
+    // wakes that change nothing aren't rendered, this one must be.
+    _viewer->requestRedraw();
+
+    _pendingProgram = 0;
+    _pendingShaders.clear();
+
+    if (!_variants.empty())
+    {
+        _variants[_variantIndex].program = _program;
+        _variants[_variantIndex].linked = true;
+        compileVariants();
+    }
+}
+
+void NodeToy::observeShaderFiles()
+{
+    for (auto& file: _shaderLibrary.getFiles())
+    {
+        if (!_observedShaderFiles.insert(file).second)
+        {
+            continue;
+        }
+
+        // changes are handled by reloadShaders in batch callback
+        try
+        {
+            _observer->addResource(Resource(file, nullptr));
+        }
+        catch (const Resource::ResourceNotFoundError&)
+        {
+            // missing include, the watcher reports it once it's created.
+            _observer->getFileWatcher()->addFile(file);
+        }
+    }
+}
+
 void NodeToy::setupProgram()
 {
     assert(_program);
 
+    // program is swapped in update traversal
     auto sceneSS = _sceneRoot->getOrCreateStateSet();
+    sceneSS->setDataVariance(osg::Object::DYNAMIC);
     sceneSS->setAttributeAndModes(_program);
 
-    // extra uniforms
+    // built-ins block, extra uniforms are kept for shaders that don't use it
+    auto rect = osgq::getWindowRect(*_viewer);
+    _builtins.setResolution(osg::Vec2(rect.z(), rect.w()));
+    ToyBuiltins::bindProgram(*_program);
+    sceneSS->setAttribute(_builtins.getBinding());
+
     _mouseUniform = new osg::Uniform("mouse", osg::Vec2());
     sceneSS->addUniform(_mouseUniform);
 
-    auto rect = osgq::getWindowRect(*_viewer);
-    _resolutionUniform = new osg::Uniform("resolution", osg::Vec2(rect.z(), rect.w()));
+    _resolutionUniform = new osg::Uniform("resolution", _builtins.getResolution());
     sceneSS->addUniform(_resolutionUniform);
 
     OSG_NOTICE << "Use program for scene root." << std::endl;
 }
 
+void NodeToy::applyProgramCache()
+{
+    assert(_program);
+    _programCache.apply(_program, _sceneRoot->getStateSet());
+}
+
 void NodeToy::readDefines(osg::ArgumentParser& args)
 {
     auto sceneSS = _sceneRoot->getOrCreateStateSet();
@@ -612,7 +1328,7 @@ void NodeToy::readDefines(osg::ArgumentParser& args)
         auto pos = name.find_first_of('=');
         if (pos != std::string::npos)
         {
-            sceneSS->setDefine(name.substr(0, pos), name.substr(pos));
+            sceneSS->setDefine(name.substr(0, pos), name.substr(pos + 1));
         }
         else
         {
@@ -621,24 +1337,297 @@ void NodeToy::readDefines(osg::ArgumentParser& args)
     }
 }
 
+void NodeToy::readVariants(osg::ArgumentParser& args)
+{
+    _variants.push_back(Variant());
+    std::string arg;
+    while (args.read("--variant", arg))
+    {
+        auto pos = arg.find_first_of('=');
+        auto name = arg.substr(0, pos);
+        _variantDefines.push_back(name);
+
+        std::vector<Variant> variants;
+        for (auto& variant: _variants)
+        {
+            if (pos == std::string::npos)
+            {
+                // undefined, then defined
+                variants.push_back(variant);
+                variants.push_back(variant);
+                variants.back().defines[name] = "";
+                continue;
+            }
+
+            for (auto& value: sutil::split(arg.substr(pos + 1), '|'))
+            {
+                variants.push_back(variant);
+                variants.back().defines[name] = value;
+            }
+        }
+        _variants.swap(variants);
+    }
+
+    if (_variantDefines.empty())
+    {
+        _variants.clear();
+        return;
+    }
+
+    if (!_program)
+    {
+        OSG_WARN << "--variant is ignored, there is no program." << std::endl;
+        _variants.clear();
+        _variantDefines.clear();
+        return;
+    }
+
+    for (auto& variant: _variants)
+    {
+        for (auto& name: _variantDefines)
+        {
+            auto iter = variant.defines.find(name);
+            if (iter == variant.defines.end())
+            {
+                continue;
+            }
+
+            if (!variant.name.empty())
+            {
+                variant.name += ' ';
+            }
+            variant.name += iter->second.empty() ? name : name + '=' + iter->second;
+        }
+
+        if (variant.name.empty())
+        {
+            variant.name = "none";
+        }
+    }
+
+    OSG_NOTICE << _variants.size() << " shader variants, F7 and F8 switch between them."
+               << std::endl;
+
+    _variantIndex = 0;
+    _variants.front().program = _program;
+    _variants.front().linked = true;
+    applyVariant(_variantIndex, _sceneRoot->getOrCreateStateSet());
+}
+
+void NodeToy::applyVariant(int index, osg::StateSet* stateSet)
+{
+    auto& variant = _variants[index];
+    for (auto& name: _variantDefines)
+    {
+        auto iter = variant.defines.find(name);
+        if (iter != variant.defines.end())
+        {
+            stateSet->setDefine(name, iter->second);
+        }
+        else
+        {
+            stateSet->removeDefine(name);
+        }
+    }
+}
+
+void NodeToy::compileVariants()
+{
+    for (auto i = 0; i < static_cast<int>(_variants.size()); ++i)
+    {
+        if (i != _variantIndex)
+        {
+            compileVariant(i);
+        }
+    }
+}
+
+void NodeToy::compileVariant(int index)
+{
+    auto& variant = _variants[index];
+    variant.program = new osg::Program(*_program, osg::CopyOp::SHALLOW_COPY);
+    variant.linked = false;
+
+    // scene root defines with those of variant
+    osg::ref_ptr<osg::StateSet> defines = new osg::StateSet;
+    defines->setDefineList(_sceneRoot->getStateSet()->getDefineList());
+    applyVariant(index, defines);
+
+    auto callback = [this, index, defines](osg::Program* program, bool linked) {
+        auto& variant = _variants[index];
+        // superseded by reloaded program
+        if (program != variant.program)
+        {
+            return;
+        }
+
+        if (!linked && program->getProgramBinary())
+        {
+            _programCache.reject(*program, defines);
+            compileVariant(index);
+            return;
+        }
+
+        variant.linked = linked;
+        if (!linked)
+        {
+            OSG_WARN << "Failed to link variant " << variant.name << std::endl;
+            _shaderLibrary.logFileIndices();
+        }
+    };
+
+    _programCache.restore(variant.program, defines);
+    _compiler.compile(variant.program, defines, callback);
+}
+
+void NodeToy::switchVariant(int step)
+{
+    if (_variants.size() < 2)
+    {
+        return;
+    }
+
+    auto size = static_cast<int>(_variants.size());
+    auto index = ((_variantIndex + step) % size + size) % size;
+    auto& variant = _variants[index];
+    if (!variant.linked)
+    {
+        OSG_NOTICE << "Variant " << variant.name << " is not linked yet." << std::endl;
+        return;
+    }
+
+    _variantIndex = index;
+    applyVariant(index, _sceneRoot->getStateSet());
+    _program = variant.program.get();
+    _sceneRoot->getStateSet()->setAttributeAndModes(_program);
+    applyProgramCache();
+
+    // pending program was linked with defines of previous variant.
+    if (_pendingProgram)
+    {
+        compileProgram(_pendingProgram.get());
+    }
+
+    // frame number helps to find the variant in --profile output
+    OSG_NOTICE << "Frame " << _viewer->getFrameStamp()->getFrameNumber() << " variant "
+               << index + 1 << "/" << size << " : " << variant.name << std::endl;
+}
+
 void NodeToy::createShadertoyNode()
 {
     assert(_program);
+    _sceneRoot->addChild(_lateLatch.getLatchDrawable());
     _sceneRoot->addChild(osgf::getNdcQuad());
+    _lateLatch.setGraphicsContext(_viewer->getCamera()->getGraphicsContext());
     _vert = new osg::Shader(osg::Shader::VERTEX, toyVertexSource);
     _program->addShader(_vert);
 
     if (!_frag)
     {
-        auto file = createDefaultFrag();
-        _frag = osgDB::readShaderFile(osg::Shader::FRAGMENT, file);
-        _observer->addResource(createShaderResource(_frag));
-        _program->addShader(_frag);
+        _frag = createShader(createDefaultFrag(), osg::Shader::FRAGMENT);
     }
 
     OSG_NOTICE << "Draw unit ndc quad with pass through vertex shader." << std::endl;
 }
 
+void NodeToy::readAccumulation(osg::ArgumentParser& args)
+{
+    auto maxSamples = 0;
+    if (!args.read("--accumulate", maxSamples) && !args.read("--accumulate"))
+    {
+        return;
+    }
+    _accumulator.setMaxSamples(std::max(0, maxSamples));
+
+    auto numBands = 1;
+    if (args.read("--accumulate-bands", numBands))
+    {
+        _accumulator.setNumBands(std::max(1, numBands));
+    }
+
+    // quad is drawn into the accumulation target instead of the screen.
+    auto quad = osgf::getNdcQuad();
+    _sceneRoot->removeChild(quad);
+    auto rect = osgq::getWindowRect(*_viewer);
+    _accumulator.setup(_sceneRoot, quad, toyVertexSource, rect.z(), rect.w());
+    OSG_NOTICE << "Accumulate samples of the quad, sample index is uniform toy_SampleIndex."
+               << std::endl;
+}
+
+void NodeToy::readDynamicResolution(osg::ArgumentParser& args)
+{
+    auto targetTime = 0.0;
+    if (!args.read("--dynamic-resolution", targetTime))
+    {
+        return;
+    }
+
+    // buffers would need their targets reallocated with every scale change.
+    if (_accumulator.isEnabled() || args.find("--buffer") != -1)
+    {
+        OSG_WARN << "--dynamic-resolution doesn't work with --accumulate or --buffer, "
+                    "ignore it."
+                 << std::endl;
+        return;
+    }
+
+    _dynamicResolution.setTargetTime(targetTime);
+
+    auto minScale = 0.25f;
+    if (args.read("--dynamic-resolution-min", minScale))
+    {
+        _dynamicResolution.setMinScale(osg::clampBetween(minScale, 0.01f, 1.0f));
+    }
+
+    std::string filter;
+    if (args.read("--dynamic-resolution-filter", filter))
+    {
+        filter = sutil::tolower(filter);
+        if (filter == "sharp")
+        {
+            _dynamicResolution.setFilter(DynamicResolution::SHARP);
+        }
+        else if (filter != "bilinear")
+        {
+            OSG_WARN << "Unknown upscale filter " << filter << ", use bilinear."
+                     << std::endl;
+        }
+    }
+
+    // late latch is drawn with the quad in the scaled camera.
+    auto scene = new osg::Group;
+    scene->setName("DynamicResolutionScene");
+    scene->addChild(_lateLatch.getLatchDrawable());
+    scene->addChild(osgf::getNdcQuad());
+    _sceneRoot->removeChild(_lateLatch.getLatchDrawable());
+    _sceneRoot->removeChild(osgf::getNdcQuad());
+
+    auto rect = osgq::getWindowRect(*_viewer);
+    _dynamicResolution.setup(_sceneRoot, scene, toyVertexSource, rect.z(), rect.w());
+    OSG_NOTICE << "Scale shadertoy quad towards " << targetTime << " ms of gpu time."
+               << std::endl;
+}
+
+void NodeToy::readBuffers(osg::ArgumentParser& args)
+{
+    std::string buffer;
+    std::string file;
+    while (args.read("--buffer", buffer, file))
+    {
+        _multiPass.addBuffer(sutil::toupper(buffer), file);
+    }
+
+    if (_multiPass.empty())
+    {
+        return;
+    }
+
+    auto rect = osgq::getWindowRect(*_viewer);
+    _multiPass.setup(_sceneRoot, toyVertexSource, rect.z(), rect.w());
+    observeShaderFiles();
+    OSG_NOTICE << "Draw buffer passes before the scene." << std::endl;
+}
+
 void NodeToy::readNode(osg::ArgumentParser& args)
 {
     int n = 0;
@@ -726,7 +1715,7 @@ void NodeToy::readNode(osg::ArgumentParser& args)
     }
 }
 
-void NodeToy::readExportTextures(const std::string& script)
+void NodeToy::readExportTextures(osg::ArgumentParser& args, const std::string& script)
 {
     std::ifstream ifs(script);
     if (!ifs)
@@ -735,57 +1724,79 @@ void NodeToy::readExportTextures(const std::string& script)
         return;
     }
 
+    _textureExporter.reset(new TextureExporter(
+        _sceneRoot, [this](const std::string& frag) { return createExportProgram(frag); }));
+
+    int waveSize;
+    if (args.read("--export-wave", waveSize))
+    {
+        _textureExporter->setWaveSize(std::max(1, waveSize));
+    }
+
+    int tileSize;
+    if (args.read("--export-tile", tileSize))
+    {
+        _textureExporter->setTileSize(std::max(1, tileSize));
+    }
+
     std::string line;
     auto rect = osgq::getWindowRect(*_viewer);
 
     while (std::getline(ifs, line))
     {
-        ExportTexture et;
-        int width = rect.z();
-        int height = rect.w();
-        int packing;
+        TextureExporter::Item item;
+        item.width = rect.z();
+        item.height = rect.w();
         std::string format;
         std::string type;
 
         // line can be output_name frag [width height]
         std::stringstream ss(line);
-        if (ss >> et.output_name && ss >> et.frag && ss >> width && ss >> height &&
-                ss >> format && ss >> type && ss >> packing)
-        {
-            et.img = new osg::Image;
-            et.img->allocateImage(width, height, 1, stringToPixelFormat(format),
-                    stringToPixelType(type), packing);
-            addExportTexture(et);
-        }
-        else
+        if (!(ss >> item.outputName && ss >> item.frag && ss >> item.width &&
+                ss >> item.height && ss >> format && ss >> type && ss >> item.packing))
         {
             OSG_FATAL << "Failed to read export texture from \"" << line << "\""
             << std::endl;
+            continue;
+        }
+
+        try
+        {
+            item.pixelFormat = stringToPixelFormat(format);
+            item.pixelType = stringToPixelType(type);
+        }
+        catch (const std::runtime_error& e)
+        {
+            OSG_FATAL << e.what() << " in \"" << line << "\"" << std::endl;
+            continue;
         }
+
+        // rendered into color texture, there is no depth or stencil to read back.
+        if (item.pixelFormat == GL_DEPTH_COMPONENT || item.pixelFormat == GL_STENCIL_INDEX)
+        {
+            OSG_FATAL << "Can't export " << format << " in \"" << line << "\"" << std::endl;
+            continue;
+        }
+
+        _textureExporter->addItem(item);
     }
 }
 
-void NodeToy::addExportTexture(ExportTexture& et)
+osg::Program* NodeToy::createExportProgram(const std::string& frag)
 {
-    auto camera = osgf::createRttCamera(
-            0, 0, et.img->s(), et.img->t(), osg::Camera::FRAME_BUFFER_OBJECT);
-
-    camera->attach(osg::Camera::COLOR_BUFFER0, et.img);
-
     auto program = new osg::Program;
     program->addShader(new osg::Shader(osg::Shader::VERTEX, toyVertexSource));
-    program->addShader(osgDB::readShaderFile(osg::Shader::FRAGMENT, et.frag));
-
-    auto ss = camera->getOrCreateStateSet();
-    ss->setAttributeAndModes(program);
-    ss->addUniform(new osg::Uniform("resolution", osg::Vec2(et.img->s(), et.img->t())));
-
-    camera->addChild(osgf::getNdcQuad());
-
-    _sceneRoot->addChild(camera);
-
-    _exportTextureList.push_back(et);
-    OSG_NOTICE << "Create rtt camera for " << et.output_name << std::endl;
+    try
+    {
+        auto file = osgDB::getRealPath(osgDB::findDataFile(frag));
+        program->addShader(
+            new osg::Shader(osg::Shader::FRAGMENT, _shaderLibrary.getSource(file)));
+    }
+    catch (const ShaderIncludeError& e)
+    {
+        OSG_FATAL << e.what() << std::endl;
+    }
+    return program;
 }
 
 }  // namespace ntoy
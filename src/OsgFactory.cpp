@@ -5,6 +5,7 @@
 
 #include <osg/AnimationPath>
 #include <osg/BlendFunc>
+#include <osg/Camera>
 #include <osg/Drawable>
 #include <osg/FrameBufferObject>
 #include <osg/Geode>
@@ -685,8 +686,19 @@ void reloadShader(osg::Shader& shader, const std::string& file)
 
     // A new Shader is created, Shader::_computeShaderDefines will be called twice! Are
     // there any other way to do this?
-    auto s = osgDB::readShaderFile(shader.getType(), sourceFile, options);
-    shader.setShaderSource(s->getShaderSource());
+    osg::ref_ptr<osg::Shader> s =
+        osgDB::readShaderFile(shader.getType(), sourceFile, options);
+    if (!s)
+    {
+        OSG_WARN << "Failed to read " << sourceFile << std::endl;
+        return;
+    }
+
+    // setShaderSource dirties every program that use this shader.
+    if (s->getShaderSource() != shader.getShaderSource())
+    {
+        shader.setShaderSource(s->getShaderSource());
+    }
 }
 
 osg::Camera* createPrerenderCamera(int x, int y, int width, int height)
@@ -725,6 +737,27 @@ osg::Camera* createOrthoCamera(
     return camera;
 }
 
+namespace detail
+{
+
+class DrawFuncCallback : public osg::Camera::DrawCallback
+{
+public:
+    DrawFuncCallback(CameraDrawFunc func) : _func(func) {}
+
+    void operator()(osg::RenderInfo& renderInfo) const override { _func(renderInfo); }
+
+private:
+    CameraDrawFunc _func;
+};
+
+}  // namespace detail
+
+void* createDrawCallback(CameraDrawFunc func)
+{
+    return static_cast<osg::Camera::DrawCallback*>(new detail::DrawFuncCallback(func));
+}
+
 osg::FrameBufferObject* addFboRtt(
     osg::StateSet& ss, osg::Texture2D* tex0, osg::Texture2D* tex1, osg::Texture2D* tex2)
 {
@@ -123,6 +123,7 @@ osg::NodePathList searchNodes(osg::Node& node, T* (osg::Node::*asFunc)(), int tr
 #define INSTANTIATE_searchNodes(T)                                                         \
     template osg::NodePathList searchNodes<T>(osg::Node&, T * (osg::Node::*)(), int);
 
+INSTANTIATE_searchNodes(osg::Camera);
 INSTANTIATE_searchNodes(osg::Drawable);
 INSTANTIATE_searchNodes(osg::Geometry);
 INSTANTIATE_searchNodes(osg::Group);
@@ -144,8 +145,19 @@ void* getGraphicsWindow(const osgViewer::Viewer& viewer)
 
 const void* getGraphicsContextTraits(const osgViewer::Viewer& viewer)
 {
-    return static_cast<const osgViewer::GraphicsWindow*>(getGraphicsWindow(viewer))
-        ->getTraits();
+    // not necessary a window, it can be a pbuffer.
+    auto gc = viewer.getCamera()->getGraphicsContext();
+    if (!gc)
+    {
+        osgViewer::Viewer::Contexts contexts;
+        const_cast<osgViewer::Viewer&>(viewer).getContexts(contexts);
+        if (contexts.empty())
+        {
+            throw std::runtime_error("Failed to get graphics context");
+        }
+        gc = contexts[0];
+    }
+    return gc->getTraits();
 }
 
 osg::Vec4i getWindowRect(const osgViewer::Viewer& viewer)
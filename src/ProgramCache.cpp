@@ -0,0 +1,337 @@
+#include <ProgramCache.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+#include <osg/Drawable>
+#include <osg/GLExtensions>
+#include <osg/StateSet>
+#include <osgDB/FileNameUtils>
+#include <osgDB/FileUtils>
+
+#include <OsgFactory.h>
+#include <StringUtil.h>
+
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#    define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#    define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+
+namespace ntoy
+{
+
+namespace
+{
+
+const char binaryMagic[4] = {'N', 'T', 'P', 'B'};
+
+}  // namespace
+
+ProgramCache::ProgramCache() : _directory(getDefaultDirectory())
+{
+    _recorder = osgf::createDrawable(
+        [this](osg::RenderInfo& renderInfo, const osg::Drawable*) { record(renderInfo); });
+    _recorder->setName("ProgramBinaryRecorder");
+    _recorder->setUseDisplayList(false);
+    _recorder->setCullingActive(false);
+}
+
+void ProgramCache::apply(osg::Program* program, const osg::StateSet* defines)
+{
+    auto key = computeKey(*program, defines);
+    auto binary = restore(program, defines);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _program = program;
+    _key = key;
+    _binaryApplied = binary;
+    _binaryRejected = false;
+    _needRecord = !binary;
+    _hintRequested = false;
+    _recorded = 0;
+}
+
+bool ProgramCache::restore(osg::Program* program, const osg::StateSet* defines)
+{
+    auto key = computeKey(*program, defines);
+    auto binary = find(key);
+    program->setProgramBinary(binary);
+
+    if (binary)
+    {
+        OSG_NOTICE << "Use cached program binary " << key << std::endl;
+    }
+    return binary != 0;
+}
+
+void ProgramCache::reject(const osg::Program& program, const osg::StateSet* defines)
+{
+    auto key = computeKey(program, defines);
+    OSG_NOTICE << "Program binary " << key << " is rejected, link from source."
+               << std::endl;
+    remove(key);
+}
+
+bool ProgramCache::update()
+{
+    osg::ref_ptr<osg::ProgramBinary> recorded;
+    osg::ref_ptr<osg::Program> program;
+    std::string key;
+    bool rejected;
+    bool linkFailed;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        linkFailed = _linkFailed;
+        _linkFailed = false;
+        recorded.swap(_recorded);
+        program = _program;
+        key = _key;
+        rejected = _binaryRejected;
+        _binaryRejected = false;
+        _needRecord |= rejected;
+    }
+
+    if (recorded)
+    {
+        add(key, recorded);
+    }
+
+    if (rejected)
+    {
+        OSG_NOTICE << "Program binary " << key << " is rejected, link from source."
+                   << std::endl;
+        remove(key);
+        program->setProgramBinary(0);
+        program->dirtyProgram();
+    }
+    return !linkFailed;
+}
+
+std::string ProgramCache::getDefaultDirectory()
+{
+    auto dir = std::getenv("NTOY_CACHE_DIR");
+    if (dir)
+    {
+        return dir;
+    }
+
+    dir = std::getenv("XDG_CACHE_HOME");
+    if (dir)
+    {
+        return osgDB::concatPaths(dir, "ntoy");
+    }
+
+    dir = std::getenv("HOME");
+    if (dir)
+    {
+        return osgDB::concatPaths(dir, ".cache/ntoy");
+    }
+
+    return "";
+}
+
+std::string ProgramCache::computeKey(
+    const osg::Program& program, const osg::StateSet* defines)
+{
+    auto h = sutil::hash("", 0);
+    for (auto i = 0u; i < program.getNumShaders(); ++i)
+    {
+        auto shader = program.getShader(i);
+        h = sutil::hash(std::to_string(shader->getType()) + '\n', h);
+        h = sutil::hash(shader->getShaderSource().c_str(),
+            shader->getShaderSource().size() + 1, h);
+    }
+
+    if (defines)
+    {
+        for (auto& item: defines->getDefineList())
+        {
+            h = sutil::hash(item.first + '=' + item.second.first + ';', h);
+        }
+    }
+
+    return sutil::toHex(h);
+}
+
+void ProgramCache::record(osg::RenderInfo& renderInfo)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_program || (!_needRecord && !_binaryApplied))
+    {
+        return;
+    }
+
+    auto& state = *renderInfo.getState();
+    auto pcp = _program->getPCP(state);
+    if (!pcp || pcp->needsLink())
+    {
+        return;
+    }
+
+    if (!pcp->isLinked())
+    {
+        // nothing to record for broken source
+        _linkFailed = !_binaryApplied;
+        _binaryRejected = _binaryApplied;
+        _binaryApplied = false;
+        _needRecord = false;
+        return;
+    }
+
+    _binaryApplied = false;
+    if (!_needRecord)
+    {
+        return;
+    }
+    _needRecord = false;
+
+    auto extensions = state.get<osg::GLExtensions>();
+    if (!extensions->isGetProgramBinarySupported)
+    {
+        return;
+    }
+
+    GLint length = 0;
+    extensions->glGetProgramiv(pcp->getHandle(), GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        // program was linked without the hint, relink it once with the hint set.
+        if (!_hintRequested && extensions->glProgramParameteri)
+        {
+            _hintRequested = true;
+            _needRecord = true;
+            extensions->glProgramParameteri(
+                pcp->getHandle(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            pcp->requestLink();
+        }
+        return;
+    }
+
+    GLenum format = 0;
+    osg::ref_ptr<osg::ProgramBinary> binary = new osg::ProgramBinary;
+    binary->allocate(length);
+    extensions->glGetProgramBinary(pcp->getHandle(), length, 0, &format, binary->getData());
+    binary->setFormat(format);
+    _recorded = binary;
+}
+
+void ProgramCache::setRetrievableHint(const osg::Program& program, osg::State& state)
+{
+    auto extensions = state.get<osg::GLExtensions>();
+    if (!extensions->isGetProgramBinarySupported || !extensions->glProgramParameteri)
+    {
+        return;
+    }
+
+    auto pcp = program.getPCP(state);
+    if (pcp && pcp->needsLink())
+    {
+        extensions->glProgramParameteri(
+            pcp->getHandle(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+}
+
+osg::ProgramBinary* ProgramCache::find(const std::string& key)
+{
+    auto iter = _binaries.find(key);
+    if (iter != _binaries.end())
+    {
+        return iter->second;
+    }
+
+    if (_directory.empty())
+    {
+        return 0;
+    }
+
+    std::ifstream ifs(getFileName(key), std::ios::binary);
+    if (!ifs)
+    {
+        return 0;
+    }
+
+    char magic[4];
+    std::uint32_t format = 0;
+    ifs.read(magic, sizeof(magic));
+    ifs.read(reinterpret_cast<char*>(&format), sizeof(format));
+    std::string data;
+    if (ifs)
+    {
+        data.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+
+    if (data.empty() || !std::equal(magic, magic + 4, binaryMagic))
+    {
+        OSG_WARN << "Invalid program binary " << getFileName(key) << std::endl;
+        return 0;
+    }
+
+    auto binary = new osg::ProgramBinary;
+    binary->setFormat(format);
+    binary->assign(data.size(), reinterpret_cast<const unsigned char*>(data.data()));
+    _binaries[key] = binary;
+    return binary;
+}
+
+void ProgramCache::add(const std::string& key, osg::ProgramBinary* binary)
+{
+    _binaries[key] = binary;
+
+    if (_directory.empty())
+    {
+        return;
+    }
+
+    if (!osgDB::makeDirectory(_directory))
+    {
+        OSG_WARN << "Failed to create " << _directory << std::endl;
+        return;
+    }
+
+    // write to temp then rename, never leave half written binary behind.
+    auto file = getFileName(key);
+    auto tmpFile = file + ".tmp";
+    {
+        std::ofstream ofs(tmpFile, std::ios::binary);
+        std::uint32_t format = binary->getFormat();
+        ofs.write(binaryMagic, sizeof(binaryMagic));
+        ofs.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        ofs.write(reinterpret_cast<const char*>(binary->getData()), binary->getSize());
+        if (!ofs)
+        {
+            OSG_WARN << "Failed to write " << tmpFile << std::endl;
+            return;
+        }
+    }
+
+    if (std::rename(tmpFile.c_str(), file.c_str()) != 0)
+    {
+        OSG_WARN << "Failed to rename " << tmpFile << " to " << file << std::endl;
+        return;
+    }
+
+    OSG_NOTICE << "Cache program binary " << file << std::endl;
+}
+
+void ProgramCache::remove(const std::string& key)
+{
+    _binaries.erase(key);
+    if (!_directory.empty())
+    {
+        std::remove(getFileName(key).c_str());
+    }
+}
+
+std::string ProgramCache::getFileName(const std::string& key) const
+{
+    return osgDB::concatPaths(_directory, key + ".bin");
+}
+
+}  // namespace ntoy
@@ -0,0 +1,205 @@
+#include <RenderTargetPool.h>
+
+#include <algorithm>
+#include <numeric>
+#include <set>
+
+#include <OsgFactory.h>
+
+namespace ntoy
+{
+
+namespace
+{
+
+// source format and type are only used to allocate storage, nothing is uploaded.
+void setSourceFormat(osg::Texture2D& texture, GLenum internalFormat)
+{
+    switch (internalFormat)
+    {
+        case GL_RGBA32F_ARB:
+        case GL_RGBA16F_ARB:
+            texture.setSourceFormat(GL_RGBA);
+            texture.setSourceType(GL_FLOAT);
+            break;
+
+        default:
+            texture.setSourceFormat(GL_RGBA);
+            texture.setSourceType(GL_UNSIGNED_BYTE);
+            break;
+    }
+}
+
+// Drivers pad 3 channel formats to 4.
+std::size_t getBytesPerPixel(GLenum internalFormat)
+{
+    switch (internalFormat)
+    {
+        case GL_R8:
+        case GL_R8I:
+        case GL_R8UI:
+            return 1;
+
+        case GL_RG8:
+        case GL_RG8I:
+        case GL_RG8UI:
+        case GL_R16:
+        case GL_R16F:
+            return 2;
+
+        case GL_RG16:
+        case GL_RG16F:
+        case GL_RG16I:
+        case GL_RG16UI:
+        case GL_R32F:
+            return 4;
+
+        case GL_RGB16:
+        case GL_RGB16F_ARB:
+        case GL_RGBA16:
+        case GL_RGBA16F_ARB:
+        case GL_RG32F:
+        case GL_RG32I:
+        case GL_RG32UI:
+            return 8;
+
+        case GL_RGB32F_ARB:
+        case GL_RGBA32F_ARB:
+            return 16;
+
+        default:
+            return 4;
+    }
+}
+
+}  // namespace
+
+osg::Texture2D* RenderTargetPool::acquire(
+    int width, int height, GLenum internalFormat, int samples)
+{
+    Key key(width, height, internalFormat, samples);
+    auto iter = _freeTextures.find(key);
+    if (iter != _freeTextures.end() && !iter->second.empty())
+    {
+        auto texture = iter->second.back();
+        iter->second.pop_back();
+        _acquired[texture.get()] = key;
+        return texture.release();
+    }
+
+    auto texture = osgf::createTexture(
+        internalFormat, width, height, osg::Texture::LINEAR, osg::Texture::LINEAR);
+    setSourceFormat(*texture, internalFormat);
+    texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+    _acquired[texture] = key;
+
+    _bytes += estimateBytes(key);
+    _peakBytes = std::max(_peakBytes, _bytes);
+    return texture;
+}
+
+std::vector<osg::ref_ptr<osg::Texture2D>> RenderTargetPool::acquireTransient(
+    const std::vector<TransientTarget>& targets)
+{
+    std::vector<std::size_t> order(targets.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&targets](auto lhs, auto rhs) {
+        return targets[lhs].firstPass < targets[rhs].firstPass;
+    });
+
+    // texture shared by targets of non overlapping passes
+    struct Slot
+    {
+        Key key;
+        int lastPass;
+        osg::Texture2D* texture;
+    };
+    std::vector<Slot> slots;
+
+    std::vector<osg::ref_ptr<osg::Texture2D>> textures(targets.size());
+    for (auto index: order)
+    {
+        auto& target = targets[index];
+        Key key(target.width, target.height, target.internalFormat, target.samples);
+        auto iter = std::find_if(slots.begin(), slots.end(), [&](const Slot& slot) {
+            return slot.key == key && slot.lastPass < target.firstPass;
+        });
+
+        if (iter == slots.end())
+        {
+            auto texture = acquire(
+                target.width, target.height, target.internalFormat, target.samples);
+            slots.push_back(Slot{key, target.lastPass, texture});
+            textures[index] = texture;
+        }
+        else
+        {
+            iter->lastPass = target.lastPass;
+            textures[index] = iter->texture;
+        }
+    }
+
+    return textures;
+}
+
+void RenderTargetPool::release(osg::Texture2D* texture)
+{
+    auto iter = _acquired.find(texture);
+    if (iter == _acquired.end())
+    {
+        OSG_WARN << "Texture is not acquired from the pool." << std::endl;
+        return;
+    }
+
+    _freeTextures[iter->second].push_back(texture);
+    _acquired.erase(iter);
+}
+
+void RenderTargetPool::releaseTransient(
+    const std::vector<osg::ref_ptr<osg::Texture2D>>& textures)
+{
+    std::set<osg::Texture2D*> released;
+    for (auto& texture: textures)
+    {
+        if (texture && released.insert(texture.get()).second)
+        {
+            release(texture.get());
+        }
+    }
+}
+
+void RenderTargetPool::trim()
+{
+    for (auto& item: _freeTextures)
+    {
+        _bytes -= estimateBytes(item.first) * item.second.size();
+    }
+    _freeTextures.clear();
+}
+
+unsigned RenderTargetPool::getNumTextures() const
+{
+    auto count = getNumAcquired();
+    for (auto& item: _freeTextures)
+    {
+        count += item.second.size();
+    }
+    return count;
+}
+
+std::size_t RenderTargetPool::estimateBytes(
+    int width, int height, GLenum internalFormat, int samples)
+{
+    // resolved texture and multisample renderbuffer
+    auto pixels = static_cast<std::size_t>(width) * height;
+    return pixels * getBytesPerPixel(internalFormat) * (1 + samples);
+}
+
+std::size_t RenderTargetPool::estimateBytes(const Key& key)
+{
+    return estimateBytes(
+        std::get<0>(key), std::get<1>(key), std::get<2>(key), std::get<3>(key));
+}
+
+}  // namespace ntoy
@@ -1,69 +1,14 @@
 #include <Resource.h>
 
-#ifdef WIN32
-
-#else
-#    include <sys/stat.h>
-#    include <sys/types.h>
-#    include <unistd.h>
-#endif
-
 #include <cassert>
 
+#include <osg/Timer>
 #include <osgDB/FileUtils>
 #include <OsgFactory.h>
 
 namespace ntoy
 {
 
-class StatError : public std::runtime_error
-{
-public:
-    using runtime_error::runtime_error;
-};
-
-const char* statErrorToString(int errorNumber)
-{
-    switch (errorNumber)
-    {
-        case EACCES:
-            return "EACCES";
-        case EBADF:
-            return "EBADF";
-        case EFAULT:
-            return "EFAULT";
-        case ELOOP:
-            return "ELOOP";
-        case ENAMETOOLONG:
-            return "ENAMETOOLONG";
-        case ENOENT:
-            return "ENOENT";
-        case ENOMEM:
-            return "ENOMEM";
-        case ENOTDIR:
-            return "ENOTDIR";
-        case EOVERFLOW:
-            return "EOVERFLOW";
-        default:
-            return "";
-    }
-}
-
-auto getLastModifyTime(const std::string& file)
-{
-    struct stat statbuf;
-    if (stat(file.c_str(), &statbuf) != 0)
-    {
-        throw StatError(std::string("stat failed with ") + statErrorToString(errno));
-    }
-#ifdef WIN32
-    return statbuf.st_mtime;
-#else
-    return statbuf.st_mtim;
-#endif
-
-}
-
 Resource::Resource(const std::string& file, ModifiedCallback ModifiedCallback)
     : _callback(ModifiedCallback)
 {
@@ -74,32 +19,6 @@ Resource::Resource(const std::string& file, ModifiedCallback ModifiedCallback)
     }
 }
 
-bool Resource::check()
-{
-    try
-    {
-        // reload supershape if file changed
-#ifdef WIN32
-        auto mtime = getLastModifyTime(_file);
-        if (mtime != _mtime)
-#else
-        auto mtime = getLastModifyTime(_file);
-        if (mtime.tv_nsec != _mtime.tv_nsec)
-#endif
-        {
-            _mtime = mtime;
-            invokeCallback();
-            return true;
-        }
-    }
-    catch (const StatError& e)
-    {
-        OSG_WARN << e.what() << std::endl;
-    }
-
-    return false;
-}
-
 void Resource::invokeCallback()
 {
     if (_callback)
@@ -119,37 +38,63 @@ Resource createShaderResource(osg::Shader* shader)
     return Resource(file, callback);
 }
 
+ResourceObserver::ResourceObserver() : _watcher(createFileWatcher())
+{
+    OSG_NOTICE << "Observe files with " << _watcher->getName() << std::endl;
+}
+
 bool ResourceObserver::run(osg::Object* object, osg::Object* data)
 {
-    std::map<std::string, bool> checkedFiles;
+    if (data->asNodeVisitor())
+    {
+        poll();
+    }
+
+    return traverse(object, data);
+}
+
+void ResourceObserver::poll()
+{
+    auto time = osg::Timer::instance()->time_s();
+
+    _changedFiles.clear();
+    _watcher->poll(_changedFiles);
+    _coalescer.add(_changedFiles, time);
 
-    auto visitor = data->asNodeVisitor();
-    if (visitor)
+    _changedFiles.clear();
+    if (!_coalescer.collect(time, _changedFiles))
     {
-        for (auto& resource: _resources)
+        return;
+    }
+
+    for (auto& file: _changedFiles)
+    {
+        auto iter = _resources.find(file);
+        if (iter == _resources.end())
+        {
+            continue;
+        }
+
+        for (auto& resource: iter->second)
         {
-            auto iter = checkedFiles.find(resource.getFile());
-            if (iter == checkedFiles.end())
-            {
-                auto b = resource.check();
-                checkedFiles.insert(std::make_pair(resource.getFile(), b));
-            }
-            else
-            {
-                if (iter->second)
-                {
-                    resource.invokeCallback();
-                }
-            }
+            resource.invokeCallback();
         }
     }
 
-    return traverse(object, data);
+    if (_batchCallback)
+    {
+        _batchCallback(_changedFiles);
+    }
 }
 
 void ResourceObserver::addResource(const Resource& resource)
 {
-    _resources.push_back(resource);
+    auto& resources = _resources[resource.getFile()];
+    if (resources.empty())
+    {
+        _watcher->addFile(resource.getFile());
+    }
+    resources.push_back(resource);
     OSG_NOTICE << "Observing " << resource.getFile() << std::endl;
 }
 
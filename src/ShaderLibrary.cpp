@@ -0,0 +1,321 @@
+#include <ShaderLibrary.h>
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <memory>
+#include <sstream>
+
+#include <osg/Notify>
+#include <osgDB/FileNameUtils>
+#include <osgDB/FileUtils>
+
+#include <StringUtil.h>
+
+namespace ntoy
+{
+
+namespace
+{
+
+enum class Directive
+{
+    NONE,
+    INCLUDE,
+    ONCE,
+    VERSION
+};
+
+std::string readWord(const std::string& line, std::string::size_type& pos)
+{
+    while (pos < line.size() && std::isspace(line[pos]))
+    {
+        ++pos;
+    }
+
+    auto start = pos;
+    while (pos < line.size() && (std::isalnum(line[pos]) || line[pos] == '_'))
+    {
+        ++pos;
+    }
+
+    return line.substr(start, pos - start);
+}
+
+// "file", <file> or file
+std::string readIncludeName(const std::string& line, std::string::size_type pos)
+{
+    while (pos < line.size() && std::isspace(line[pos]))
+    {
+        ++pos;
+    }
+
+    if (pos == line.size())
+    {
+        return "";
+    }
+
+    auto close = ' ';
+    if (line[pos] == '"')
+    {
+        close = '"';
+        ++pos;
+    }
+    else if (line[pos] == '<')
+    {
+        close = '>';
+        ++pos;
+    }
+
+    auto end = close == ' ' ? line.find_first_of(" \t\r", pos) : line.find(close, pos);
+    return line.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+}
+
+Directive parseDirective(const std::string& line, std::string& include)
+{
+    auto pos = line.find_first_not_of(" \t");
+    if (pos == std::string::npos || line[pos] != '#')
+    {
+        return Directive::NONE;
+    }
+
+    ++pos;
+    auto word = readWord(line, pos);
+    if (word == "pragma")
+    {
+        word = readWord(line, pos);
+        if (word == "once")
+        {
+            return Directive::ONCE;
+        }
+    }
+
+    if (word == "version")
+    {
+        return Directive::VERSION;
+    }
+
+    if (word == "include")
+    {
+        include = readIncludeName(line, pos);
+        return include.empty() ? Directive::NONE : Directive::INCLUDE;
+    }
+
+    return Directive::NONE;
+}
+
+}  // namespace
+
+const std::string& ShaderLibrary::getSource(const std::string& file)
+{
+    std::vector<std::string> stack;
+    return expand(file, stack);
+}
+
+void ShaderLibrary::addBuiltin(const std::string& name, const std::string& source)
+{
+    _builtins[name] = source;
+}
+
+void ShaderLibrary::logFileIndices() const
+{
+    OSG_WARN << "Source string numbers of #line :" << std::endl;
+    for (auto i = 0u; i < _indexedFiles.size(); ++i)
+    {
+        OSG_WARN << "  " << i + 1 << " : " << _indexedFiles[i] << std::endl;
+    }
+}
+
+void ShaderLibrary::invalidate(const std::string& file, FileSet& invalidatedFiles)
+{
+    if (!invalidatedFiles.insert(file).second)
+    {
+        return;
+    }
+
+    _sources.erase(file);
+
+    auto iter = _includedBy.find(file);
+    if (iter != _includedBy.end())
+    {
+        // copy, expand might change it later
+        auto includers = iter->second;
+        for (auto& includer: includers)
+        {
+            invalidate(includer, invalidatedFiles);
+        }
+    }
+}
+
+const std::string& ShaderLibrary::expand(
+    const std::string& file, std::vector<std::string>& stack)
+{
+    auto iter = _sources.find(file);
+    if (iter != _sources.end())
+    {
+        return iter->second;
+    }
+
+    if (std::find(stack.begin(), stack.end(), file) != stack.end())
+    {
+        std::string cycle;
+        for (auto& f: stack)
+        {
+            cycle += f + " -> ";
+        }
+        throw ShaderIncludeError("include cycle " + cycle + file);
+    }
+
+    std::unique_ptr<std::istream> is;
+    auto builtin = _builtins.find(file);
+    if (builtin != _builtins.end())
+    {
+        is.reset(new std::istringstream(builtin->second));
+    }
+    else
+    {
+        is.reset(new std::ifstream(file));
+        if (!*is)
+        {
+            throw ShaderIncludeError("failed to read " + file);
+        }
+        _files.insert(file);
+    }
+
+    stack.push_back(file);
+
+    std::vector<std::string> lines;
+    std::string line;
+    auto hasVersion = false;
+    while (std::getline(*is, line))
+    {
+        std::string include;
+        hasVersion |= parseDirective(line, include) == Directive::VERSION;
+        lines.push_back(line);
+    }
+
+    // compile errors point at line and index of the file they are in. Nothing but comments
+    // may precede #version, so the first #line of a shader file follows it.
+    auto index = getFileIndex(file);
+    auto lineDirective = [index](std::size_t next) {
+        return "#line " + std::to_string(next) + " " + std::to_string(index) + "\n";
+    };
+
+    // new edges replace old ones only if expansion succeeds. A failed one keeps both, so
+    // fixing any of them invalidates file again.
+    FileSet includes;
+    auto addIncludes = [this, &file](const FileSet& edges) {
+        for (auto& include: edges)
+        {
+            _includes[file].insert(include);
+            _includedBy[include].insert(file);
+        }
+    };
+
+    std::stringstream ss;
+    std::string guard;
+    if (!hasVersion)
+    {
+        ss << lineDirective(1);
+    }
+    for (auto i = 0u; i < lines.size(); ++i)
+    {
+        std::string include;
+        switch (parseDirective(lines[i], include))
+        {
+            case Directive::INCLUDE:
+            {
+                auto includeFile = resolveInclude(file, include);
+                if (includeFile.empty())
+                {
+                    // observe where it's searched first, creating it reloads file.
+                    auto missing = osgDB::concatPaths(osgDB::getFilePath(file), include);
+                    _files.insert(missing);
+                    includes.insert(missing);
+                    addIncludes(includes);
+                    throw ShaderIncludeError(
+                        include + " included by " + file + " not found");
+                }
+
+                includes.insert(includeFile);
+                try
+                {
+                    ss << expand(includeFile, stack) << lineDirective(i + 2);
+                }
+                catch (const ShaderIncludeError&)
+                {
+                    addIncludes(includes);
+                    throw;
+                }
+                break;
+            }
+
+            case Directive::ONCE:
+                guard = "NTOY_ONCE_" + sutil::toHex(sutil::hash(file));
+                ss << "#ifndef " << guard << "\n#define " << guard << "\n"
+                   << lineDirective(i + 2);
+                break;
+
+            case Directive::VERSION:
+                ss << lines[i] << "\n" << lineDirective(i + 2);
+                break;
+
+            default:
+                ss << lines[i] << "\n";
+                break;
+        }
+    }
+
+    if (!guard.empty())
+    {
+        ss << "#endif\n";
+    }
+
+    stack.pop_back();
+
+    // drop old edges, include list might have changed.
+    for (auto& include: _includes[file])
+    {
+        _includedBy[include].erase(file);
+    }
+    _includes[file].clear();
+    addIncludes(includes);
+
+    OSG_INFO << "Expanded " << file << std::endl;
+    return _sources[file] = ss.str();
+}
+
+int ShaderLibrary::getFileIndex(const std::string& file)
+{
+    auto iter = _fileIndices.find(file);
+    if (iter != _fileIndices.end())
+    {
+        return iter->second;
+    }
+
+    _indexedFiles.push_back(file);
+    auto index = static_cast<int>(_indexedFiles.size());
+    _fileIndices[file] = index;
+    return index;
+}
+
+std::string ShaderLibrary::resolveInclude(
+    const std::string& file, const std::string& include) const
+{
+    if (_builtins.count(include))
+    {
+        return include;
+    }
+
+    // real path, same file might be included with different names.
+    auto path = osgDB::concatPaths(osgDB::getFilePath(file), include);
+    if (osgDB::fileExists(path))
+    {
+        return osgDB::getRealPath(path);
+    }
+
+    path = osgDB::findDataFile(include);
+    return path.empty() ? path : osgDB::getRealPath(path);
+}
+
+}  // namespace ntoy
@@ -1,6 +1,8 @@
 #include <StringUtil.h>
 
 #include <algorithm>
+#include <iomanip>
+#include <sstream>
 
 namespace sutil
 {
@@ -27,4 +29,43 @@ std::string tolower(const std::string& s)
     return us;
 }
 
+std::vector<std::string> split(const std::string& s, char delimiter)
+{
+    std::vector<std::string> pieces;
+    std::string::size_type start = 0;
+    while (true)
+    {
+        auto pos = s.find(delimiter, start);
+        pieces.push_back(s.substr(start, pos - start));
+        if (pos == std::string::npos)
+        {
+            break;
+        }
+        start = pos + 1;
+    }
+    return pieces;
+}
+
+std::uint64_t hash(const char* data, std::size_t size, std::uint64_t h)
+{
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+std::uint64_t hash(const std::string& s, std::uint64_t h)
+{
+    return hash(s.data(), s.size(), h);
+}
+
+std::string toHex(std::uint64_t v)
+{
+    std::stringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << v;
+    return ss.str();
+}
+
 }  // namespace sutil
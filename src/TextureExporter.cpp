@@ -0,0 +1,406 @@
+#include <TextureExporter.h>
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+
+#include <osg/BufferObject>
+#include <osg/Camera>
+#include <osg/GLExtensions>
+#include <osg/Group>
+#include <osg/Image>
+#include <osg/Program>
+#include <osg/Texture2D>
+#include <osgDB/WriteFile>
+
+#include <OsgFactory.h>
+#include <ThreadPool.h>
+#include <TileWriter.h>
+
+namespace ntoy
+{
+
+namespace
+{
+
+GLenum computeInternalFormat(GLenum pixelFormat, GLenum pixelType)
+{
+    auto channels = std::max(1u, osg::Image::computeNumComponents(pixelFormat));
+    auto index = std::min(channels, 4u) - 1;
+
+    if (pixelFormat == GL_RG_INTEGER)
+    {
+        switch (pixelType)
+        {
+            case GL_BYTE:
+                return GL_RG8I;
+            case GL_UNSIGNED_BYTE:
+                return GL_RG8UI;
+            case GL_SHORT:
+                return GL_RG16I;
+            case GL_UNSIGNED_SHORT:
+                return GL_RG16UI;
+            case GL_INT:
+                return GL_RG32I;
+            default:
+                return GL_RG32UI;
+        }
+    }
+
+    switch (pixelType)
+    {
+        case GL_FLOAT:
+        {
+            const GLenum formats[] = {GL_R32F, GL_RG32F, GL_RGB32F, GL_RGBA32F};
+            return formats[index];
+        }
+        case GL_HALF_FLOAT:
+        {
+            const GLenum formats[] = {GL_R16F, GL_RG16F, GL_RGB16F, GL_RGBA16F};
+            return formats[index];
+        }
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+        case GL_INT:
+        case GL_UNSIGNED_INT:
+        {
+            const GLenum formats[] = {GL_R16, GL_RG16, GL_RGB16, GL_RGBA16};
+            return formats[index];
+        }
+        default:
+        {
+            const GLenum formats[] = {GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+            return formats[index];
+        }
+    }
+}
+
+}  // namespace
+
+struct TextureExporter::Job
+{
+    enum Status
+    {
+        RENDERING,
+        READING,
+        READY,
+        WRITING,
+        DONE
+    };
+
+    Status status = RENDERING;
+    Item item;
+    // rendered rect of item, the whole item if it's not tiled.
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    std::shared_ptr<TileWriter> writer;
+    GLuint pbo = 0;
+    unsigned readFrame = 0;
+    osg::ref_ptr<osg::Camera> camera;
+    osg::ref_ptr<osg::Texture2D> texture;
+    osg::ref_ptr<osg::Image> image;
+    std::future<bool> written;
+};
+
+TextureExporter::TextureExporter(osg::Group* parent, ProgramFactory programFactory)
+    : _parent(parent)
+    , _programFactory(programFactory)
+    , _pool(new ThreadPool)
+{
+    _collector = osgf::createDrawable(
+        [this](osg::RenderInfo& renderInfo, const osg::Drawable*) { collect(renderInfo); });
+    _collector->setName("ExportTextureCollector");
+    _collector->setUseDisplayList(false);
+    _collector->setCullingActive(false);
+    _parent->addChild(_collector.get());
+}
+
+TextureExporter::~TextureExporter() = default;
+
+void TextureExporter::addItem(const Item& item)
+{
+    _items.push_back(item);
+}
+
+bool TextureExporter::update()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto numActiveJobs = 0;
+    auto numRenderingJobs = 0;
+    auto numImages = 0;
+    for (auto& job: _jobs)
+    {
+        switch (job->status)
+        {
+            case Job::RENDERING:
+                ++numActiveJobs;
+                ++numRenderingJobs;
+                break;
+
+            case Job::READING:
+                // render is done, the buffer is mapped later.
+                if (job->camera)
+                {
+                    _parent->removeChild(job->camera.get());
+                    job->camera = 0;
+                    job->texture = 0;
+                }
+                ++numActiveJobs;
+                break;
+
+            case Job::READY:
+            {
+                auto image = job->image;
+                if (job->writer)
+                {
+                    OSG_NOTICE << "Writing " << job->width << "x" << job->height
+                               << " tile at " << job->x << "," << job->y << " of "
+                               << job->item.outputName << std::endl;
+                    auto writer = job->writer;
+                    auto x = job->x;
+                    auto y = job->y;
+                    job->written = _pool->submit([image, writer, x, y]() {
+                        return writer->writeTile(x, y, *image);
+                    });
+                }
+                else
+                {
+                    OSG_NOTICE << "Writing " << job->item.width << "x" << job->item.height
+                               << " " << job->item.outputName << " with frag "
+                               << job->item.frag << std::endl;
+                    auto name = job->item.outputName;
+                    job->written = _pool->submit(
+                        [image, name]() { return osgDB::writeImageFile(*image, name); });
+                }
+                job->image = 0;
+                job->status = Job::WRITING;
+                ++numImages;
+                break;
+            }
+
+            case Job::WRITING:
+                if (job->written.wait_for(std::chrono::seconds(0)) ==
+                    std::future_status::ready)
+                {
+                    if (!job->written.get())
+                    {
+                        OSG_FATAL << "Failed to write " << job->item.outputName << std::endl;
+                    }
+                    job->status = Job::DONE;
+                }
+                else
+                {
+                    ++numImages;
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    _jobs.erase(std::remove_if(_jobs.begin(), _jobs.end(),
+                    [](auto& job) { return job->status == Job::DONE; }),
+        _jobs.end());
+
+    // every texture of the wave is read back.
+    if (numRenderingJobs == 0 && !_waveTextures.empty())
+    {
+        _targets.releaseTransient(_waveTextures);
+        _waveTextures.clear();
+    }
+
+    if (numActiveJobs == 0 && numImages < _waveSize)
+    {
+        startWave();
+    }
+
+    auto done = _nextItem == _items.size() && _jobs.empty();
+    if (done && _targets.getNumTextures() > 0)
+    {
+        OSG_NOTICE << "Render targets peak at " << _targets.getPeakBytes() / 1048576.0
+                   << " MiB in " << _targets.getNumTextures() << " textures." << std::endl;
+        _targets.trim();
+    }
+    return done;
+}
+
+void TextureExporter::startWave()
+{
+    std::vector<std::shared_ptr<Job>> jobs;
+    std::vector<osg::Program*> programs;
+    std::vector<RenderTargetPool::TransientTarget> targets;
+    while (static_cast<int>(jobs.size()) < _waveSize && _nextItem < _items.size())
+    {
+        auto& item = _items[_nextItem];
+        auto columns = (item.width + _tileSize - 1) / _tileSize;
+        auto rows = (item.height + _tileSize - 1) / _tileSize;
+        auto tiled = columns * rows > 1;
+
+        if (_nextTile == 0)
+        {
+            _tileProgram = _programFactory(item.frag);
+            _tileWriter.reset();
+            try
+            {
+                if (_tileProgram && tiled)
+                {
+                    _tileWriter = std::make_shared<TileWriter>(item.outputName, item.width,
+                        item.height, item.pixelFormat, item.pixelType, columns * rows);
+                }
+            }
+            catch (const std::runtime_error& e)
+            {
+                OSG_FATAL << e.what() << std::endl;
+                _tileProgram = 0;
+            }
+
+            if (!_tileProgram)
+            {
+                OSG_FATAL << "Skip " << item.outputName << std::endl;
+                ++_nextItem;
+                continue;
+            }
+        }
+
+        auto job = std::make_shared<Job>();
+        job->item = item;
+        job->x = _nextTile % columns * _tileSize;
+        job->y = _nextTile / columns * _tileSize;
+        job->width = std::min(_tileSize, item.width - job->x);
+        job->height = std::min(_tileSize, item.height - job->y);
+        job->writer = _tileWriter;
+
+        // texture is only used by its own pass, tiles of the same size share one.
+        RenderTargetPool::TransientTarget target;
+        target.width = job->width;
+        target.height = job->height;
+        target.internalFormat = computeInternalFormat(item.pixelFormat, item.pixelType);
+        target.firstPass = target.lastPass = static_cast<int>(jobs.size());
+        targets.push_back(target);
+        programs.push_back(_tileProgram.get());
+        jobs.push_back(job);
+
+        if (++_nextTile == columns * rows)
+        {
+            _nextTile = 0;
+            ++_nextItem;
+        }
+    }
+
+    _waveTextures = _targets.acquireTransient(targets);
+
+    for (auto i = 0u; i < jobs.size(); ++i)
+    {
+        auto& job = jobs[i];
+        auto& item = job->item;
+        job->texture = _waveTextures[i];
+        job->texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+        job->texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+
+        // draw in pass order, no depth buffer is needed.
+        job->camera = osgf::createRttCamera(
+            0, 0, job->width, job->height, osg::Camera::FRAME_BUFFER_OBJECT);
+        job->camera->setName(item.outputName);
+        job->camera->setRenderOrder(osg::Camera::PRE_RENDER, i);
+        job->camera->setImplicitBufferAttachmentMask(0, 0);
+        job->camera->attach(osg::Camera::COLOR_BUFFER0, job->texture.get());
+
+        std::weak_ptr<Job> weakJob = job;
+        job->camera->setFinalDrawCallback(static_cast<osg::Camera::DrawCallback*>(
+            osgf::createDrawCallback([this, weakJob](osg::RenderInfo& renderInfo) {
+                auto job = weakJob.lock();
+                if (job)
+                {
+                    readback(renderInfo, *job);
+                }
+            })));
+
+        // resolution is the whole item, a tile is drawn at gl_FragCoord.xy + tileOrigin.
+        auto ss = job->camera->getOrCreateStateSet();
+        ss->setAttributeAndModes(programs[i]);
+        ss->addUniform(new osg::Uniform("resolution", osg::Vec2(item.width, item.height)));
+        ss->addUniform(new osg::Uniform("tileOrigin", osg::Vec2(job->x, job->y)));
+
+        job->camera->addChild(osgf::getNdcQuad());
+        _parent->addChild(job->camera.get());
+        _jobs.push_back(job);
+
+        OSG_NOTICE << "Create rtt camera for " << item.outputName << " " << job->width
+                   << "x" << job->height << " at " << job->x << "," << job->y << std::endl;
+    }
+}
+
+void TextureExporter::readback(osg::RenderInfo& renderInfo, Job& job)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (job.status != Job::RENDERING)
+    {
+        return;
+    }
+
+    auto& state = *renderInfo.getState();
+    auto extensions = state.get<osg::GLExtensions>();
+    auto& item = job.item;
+    auto size = osg::Image::computeImageSizeInBytes(
+        job.width, job.height, 1, item.pixelFormat, item.pixelType, item.packing);
+
+    extensions->glGenBuffers(1, &job.pbo);
+    extensions->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, job.pbo);
+    extensions->glBufferData(GL_PIXEL_PACK_BUFFER_ARB, size, 0, GL_STREAM_READ_ARB);
+
+    state.applyTextureAttribute(0, job.texture.get());
+    glPixelStorei(GL_PACK_ALIGNMENT, item.packing);
+    glGetTexImage(GL_TEXTURE_2D, 0, item.pixelFormat, item.pixelType, 0);
+
+    extensions->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+    job.readFrame = state.getFrameStamp()->getFrameNumber();
+    job.status = Job::READING;
+}
+
+void TextureExporter::collect(osg::RenderInfo& renderInfo)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto& state = *renderInfo.getState();
+    auto extensions = state.get<osg::GLExtensions>();
+    auto frame = state.getFrameStamp()->getFrameNumber();
+
+    for (auto& job: _jobs)
+    {
+        // buffers read back in this frame are left to next frame.
+        if (job->status != Job::READING || job->readFrame >= frame)
+        {
+            continue;
+        }
+
+        auto& item = job->item;
+        extensions->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, job->pbo);
+        auto data = extensions->glMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+        if (data)
+        {
+            job->image = new osg::Image;
+            job->image->allocateImage(
+                job->width, job->height, 1, item.pixelFormat, item.pixelType, item.packing);
+            std::memcpy(job->image->data(), data, job->image->getTotalSizeInBytes());
+            extensions->glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
+            job->status = Job::READY;
+        }
+        else
+        {
+            OSG_FATAL << "Failed to map pixel buffer of " << item.outputName << std::endl;
+            job->status = Job::DONE;
+        }
+
+        extensions->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+        extensions->glDeleteBuffers(1, &job->pbo);
+        job->pbo = 0;
+    }
+}
+
+}  // namespace ntoy
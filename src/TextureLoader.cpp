@@ -0,0 +1,516 @@
+#include <TextureLoader.h>
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+#include <osg/GLExtensions>
+#include <osg/Texture1D>
+#include <osg/Texture2D>
+#include <osg/Texture3D>
+#include <osg/Vec3i>
+#include <osgDB/ReadFile>
+
+#include <MinMaxPyramid.h>
+#include <OsgFactory.h>
+#include <ThreadPool.h>
+
+namespace ntoy
+{
+
+namespace
+{
+
+bool usesMipmaps(const osg::Texture& texture)
+{
+    auto filter = texture.getFilter(osg::Texture::MIN_FILTER);
+    return filter != osg::Texture::LINEAR && filter != osg::Texture::NEAREST;
+}
+
+// Average 2x2x2 block of src for each dst pixel, edges are clamped for odd sizes.
+template<typename T>
+void downsample(const unsigned char* src, const osg::Vec3i& srcSize, std::size_t srcRow,
+    unsigned char* dst, const osg::Vec3i& dstSize, std::size_t dstRow, unsigned components)
+{
+    auto pixel = [&](int x, int y, int z) {
+        x = std::min(x, srcSize.x() - 1);
+        y = std::min(y, srcSize.y() - 1);
+        z = std::min(z, srcSize.z() - 1);
+        return reinterpret_cast<const T*>(src + (z * srcSize.y() + y) * srcRow) +
+               x * components;
+    };
+
+    auto rounding = std::is_integral<T>::value ? 0.5f : 0.0f;
+    for (auto z = 0; z < dstSize.z(); ++z)
+    {
+        for (auto y = 0; y < dstSize.y(); ++y)
+        {
+            auto row = reinterpret_cast<T*>(dst + (z * dstSize.y() + y) * dstRow);
+            for (auto x = 0; x < dstSize.x(); ++x)
+            {
+                for (auto c = 0u; c < components; ++c)
+                {
+                    auto sum = 0.0f;
+                    for (auto i = 0; i < 8; ++i)
+                    {
+                        sum += pixel(x * 2 + (i & 1), y * 2 + (i >> 1 & 1),
+                            z * 2 + (i >> 2))[c];
+                    }
+                    row[x * components + c] = static_cast<T>(sum / 8 + rounding);
+                }
+            }
+        }
+    }
+}
+
+// Append box filtered mip chain to image. Return false if image already has mipmaps or
+// its type isn't 8 bit or float, GL generates them then.
+bool generateMipmaps(osg::Image& image)
+{
+    auto type = image.getDataType();
+    if (image.isMipmap() || image.isCompressed() ||
+        (type != GL_UNSIGNED_BYTE && type != GL_FLOAT))
+    {
+        return false;
+    }
+
+    auto format = image.getPixelFormat();
+    auto packing = image.getPacking();
+    auto components = osg::Image::computeNumComponents(format);
+
+    std::vector<osg::Vec3i> sizes{osg::Vec3i(image.s(), image.t(), image.r())};
+    while (sizes.back() != osg::Vec3i(1, 1, 1))
+    {
+        auto size = sizes.back();
+        sizes.emplace_back(std::max(1, size.x() / 2), std::max(1, size.y() / 2),
+            std::max(1, size.z() / 2));
+    }
+
+    std::vector<std::size_t> offsets;
+    std::size_t totalSize = 0;
+    for (auto& size: sizes)
+    {
+        offsets.push_back(totalSize);
+        totalSize += osg::Image::computeImageSizeInBytes(
+            size.x(), size.y(), size.z(), format, type, packing);
+    }
+    offsets.push_back(totalSize);
+
+    if (sizes.size() == 1)
+    {
+        return false;
+    }
+
+    auto data = new unsigned char[totalSize];
+    std::memcpy(data, image.data(), offsets[1]);
+    for (auto level = 1u; level < sizes.size(); ++level)
+    {
+        auto& srcSize = sizes[level - 1];
+        auto& dstSize = sizes[level];
+        auto srcRow =
+            osg::Image::computeRowWidthInBytes(srcSize.x(), format, type, packing);
+        auto dstRow =
+            osg::Image::computeRowWidthInBytes(dstSize.x(), format, type, packing);
+        if (type == GL_FLOAT)
+        {
+            downsample<float>(data + offsets[level - 1], srcSize, srcRow,
+                data + offsets[level], dstSize, dstRow, components);
+        }
+        else
+        {
+            downsample<unsigned char>(data + offsets[level - 1], srcSize, srcRow,
+                data + offsets[level], dstSize, dstRow, components);
+        }
+    }
+
+    // offset of level 1 onwards
+    osg::Image::MipmapDataType mipmaps(offsets.begin() + 1, offsets.end() - 1);
+    image.setImage(image.s(), image.t(), image.r(), image.getInternalTextureFormat(),
+        format, type, data, osg::Image::USE_NEW_DELETE, packing);
+    image.setMipmapLevels(mipmaps);
+    return true;
+}
+
+// Buffers are orphaned before each write, a ring of them lets the driver overlap the copy
+// of one chunk with the transfer of the previous one.
+const std::size_t numPbos = 3;
+
+// Set size and formats of a texture without image to that of image.
+void setTextureFormat(osg::Texture& texture, const osg::Image& image)
+{
+    if (auto texture1d = dynamic_cast<osg::Texture1D*>(&texture))
+    {
+        texture1d->setTextureWidth(image.s());
+    }
+    else if (auto texture2d = dynamic_cast<osg::Texture2D*>(&texture))
+    {
+        texture2d->setTextureSize(image.s(), image.t());
+    }
+    else if (auto texture3d = dynamic_cast<osg::Texture3D*>(&texture))
+    {
+        texture3d->setTextureSize(image.s(), image.t(), image.r());
+    }
+    texture.setInternalFormat(image.getInternalTextureFormat());
+    texture.setSourceFormat(image.getPixelFormat());
+    texture.setSourceType(image.getDataType());
+}
+
+}  // namespace
+
+struct TextureLoader::Upload
+{
+    std::size_t slot = 0;
+    osg::ref_ptr<osg::Texture> texture;
+    osg::ref_ptr<osg::Image> image;
+    osg::ref_ptr<osg::Image> minMax;
+    // next chunk starts at row of slice of level
+    unsigned level = 0;
+    int slice = 0;
+    int row = 0;
+    // every level is uploaded, update can bind it.
+    bool resident = false;
+};
+
+TextureLoader::TextureLoader() : _pool(new ThreadPool)
+{
+    _streamDrawable = osgf::createDrawable(
+        [this](osg::RenderInfo& renderInfo, const osg::Drawable*) { stream(renderInfo); });
+    _streamDrawable->setName("TextureStream");
+    _streamDrawable->setUseDisplayList(false);
+    _streamDrawable->setCullingActive(false);
+}
+
+TextureLoader::~TextureLoader() = default;
+
+void TextureLoader::load(osg::StateSet* stateSet, unsigned unit, osg::Texture* texture,
+    const std::string& file, int minMaxUnit)
+{
+    if (!texture->getImage(0))
+    {
+        texture->setImage(0, getPlaceholder());
+    }
+    // streamed textures are swapped in update traversal.
+    stateSet->setDataVariance(osg::Object::DYNAMIC);
+    stateSet->setTextureAttributeAndModes(unit, texture);
+
+    Slot slot;
+    slot.file = file;
+    slot.stateSet = stateSet;
+    slot.unit = unit;
+    slot.texture = texture;
+
+    if (minMaxUnit != -1 && dynamic_cast<osg::Texture3D*>(texture))
+    {
+        // cells are read with texelFetch.
+        slot.minMaxUnit = minMaxUnit;
+        slot.minMax = new osg::Texture3D(getMinMaxPlaceholder());
+        slot.minMax->setResizeNonPowerOfTwoHint(false);
+        slot.minMax->setUseHardwareMipMapGeneration(false);
+        slot.minMax->setFilter(
+            osg::Texture::MIN_FILTER, osg::Texture::NEAREST_MIPMAP_NEAREST);
+        slot.minMax->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+        stateSet->setTextureAttribute(minMaxUnit, slot.minMax);
+
+        auto suffix = std::to_string(unit);
+        stateSet->addUniform(new osg::Uniform(("toy_MinMax" + suffix).c_str(), minMaxUnit));
+        stateSet->addUniform(new osg::Uniform(
+            ("toy_MinMaxCell" + suffix).c_str(), static_cast<float>(_minMaxCellSize)));
+    }
+
+    _slots.push_back(slot);
+    decode(_slots.size() - 1);
+}
+
+void TextureLoader::reload(const std::string& file)
+{
+    for (auto i = 0u; i < _slots.size(); ++i)
+    {
+        if (_slots[i].file == file)
+        {
+            decode(i);
+        }
+    }
+}
+
+void TextureLoader::decode(std::size_t slot)
+{
+    auto& file = _slots[slot].file;
+    auto mipmaps = usesMipmaps(*_slots[slot].texture);
+    auto minMaxCellSize = _slots[slot].minMax ? _minMaxCellSize : 0;
+
+    Job job;
+    job.slot = slot;
+    job.decoded = _pool->submit([file, mipmaps, minMaxCellSize]() {
+        Decoded decoded;
+        decoded.image = osgDB::readImageFile(file);
+        if (decoded.image && minMaxCellSize > 0)
+        {
+            decoded.minMax = createMinMaxPyramid(*decoded.image, minMaxCellSize);
+        }
+        if (decoded.image && mipmaps)
+        {
+            generateMipmaps(*decoded.image);
+        }
+        return decoded;
+    });
+    _jobs.push_back(std::move(job));
+}
+
+bool TextureLoader::update()
+{
+    auto changed = false;
+    for (auto iter = _jobs.begin(); iter != _jobs.end();)
+    {
+        if (iter->decoded.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            ++iter;
+            continue;
+        }
+
+        auto& slot = _slots[iter->slot];
+        auto decoded = iter->decoded.get();
+        auto& image = decoded.image;
+        if (image && slot.minMax && !decoded.minMax)
+        {
+            OSG_WARN << "Can't build min max pyramid of " << slot.file << ", its type "
+                     << "isn't 8, 16 bit or float." << std::endl;
+        }
+
+        if (!image)
+        {
+            OSG_WARN << "Failed to load " << slot.file << std::endl;
+        }
+        else if (slot.loaded)
+        {
+            startUpload(iter->slot, image, decoded.minMax);
+        }
+        else
+        {
+            if (decoded.minMax)
+            {
+                slot.minMax->setImage(decoded.minMax);
+            }
+            OSG_NOTICE << "Loaded " << slot.file << " " << image->s() << "x" << image->t()
+                       << "x" << image->r() << std::endl;
+            slot.texture->setImage(0, image);
+            slot.texture->setUnRefImageDataAfterApply(true);
+            slot.loaded = true;
+            changed = true;
+        }
+        iter = _jobs.erase(iter);
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto iter = _uploads.begin(); iter != _uploads.end();)
+    {
+        auto& upload = **iter;
+        if (!upload.resident)
+        {
+            ++iter;
+            continue;
+        }
+
+        auto& slot = _slots[upload.slot];
+        OSG_NOTICE << "Streamed " << slot.file << std::endl;
+        slot.stateSet->setTextureAttributeAndModes(slot.unit, upload.texture);
+        slot.texture = upload.texture;
+        changed = true;
+        if (upload.minMax)
+        {
+            slot.minMax->setImage(upload.minMax);
+        }
+        iter = _uploads.erase(iter);
+    }
+    return changed;
+}
+
+bool TextureLoader::isIdle() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _jobs.empty() && _uploads.empty();
+}
+
+void TextureLoader::startUpload(std::size_t slot, osg::Image* image, osg::Image* minMax)
+{
+    auto texture = osg::clone(_slots[slot].texture.get(), osg::CopyOp::SHALLOW_COPY);
+    texture->setImage(0, nullptr);
+
+    if (image->isCompressed())
+    {
+        // compressed blocks don't split into rows, it's uploaded as a whole.
+        texture->setImage(0, image);
+        texture->setUnRefImageDataAfterApply(true);
+        _slots[slot].stateSet->setTextureAttributeAndModes(_slots[slot].unit, texture);
+        _slots[slot].texture = texture;
+        return;
+    }
+
+    setTextureFormat(*texture, *image);
+
+    auto upload = std::make_shared<Upload>();
+    upload->slot = slot;
+    upload->texture = texture;
+    upload->image = image;
+    upload->minMax = minMax;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    // an older version of the same file is dropped.
+    auto sameSlot = [slot](const std::shared_ptr<Upload>& v) { return v->slot == slot; };
+    _uploads.erase(
+        std::remove_if(_uploads.begin(), _uploads.end(), sameSlot), _uploads.end());
+    _uploads.push_back(upload);
+}
+
+void TextureLoader::stream(osg::RenderInfo& renderInfo)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto& state = *renderInfo.getState();
+    auto extensions = state.get<osg::GLExtensions>();
+    auto contextId = state.getContextID();
+
+    if (_pbos.empty() && !_uploads.empty())
+    {
+        _pbos.resize(numPbos);
+        extensions->glGenBuffers(numPbos, _pbos.data());
+    }
+
+    std::size_t bytes = 0;
+    for (auto& upload: _uploads)
+    {
+        if (upload->resident)
+        {
+            continue;
+        }
+
+        auto& texture = *upload->texture;
+        auto& image = *upload->image;
+        auto target = texture.getTextureTarget();
+        auto format = image.getPixelFormat();
+        auto type = image.getDataType();
+        auto packing = image.getPacking();
+        auto numLevels = image.isMipmap() ? image.getNumMipmapLevels() : 1u;
+
+        if (!texture.getTextureObject(contextId))
+        {
+            // storage is allocated per level below, apply only binds it.
+            auto textureObject =
+                osg::Texture::generateTextureObject(&texture, contextId, target);
+            texture.setTextureObject(contextId, textureObject.get());
+        }
+        state.applyTextureAttribute(0, &texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, packing);
+
+        // at least one chunk per frame, or a large row would never fit in the budget.
+        while (upload->level < numLevels && (bytes == 0 || bytes < _streamBudget))
+        {
+            auto level = upload->level;
+            auto width = std::max(1, image.s() >> level);
+            auto height = std::max(1, image.t() >> level);
+            auto depth = std::max(1, image.r() >> level);
+            auto rowSize = osg::Image::computeRowWidthInBytes(width, format, type, packing);
+
+            if (upload->slice == 0 && upload->row == 0)
+            {
+                extensions->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+                auto internalFormat = texture.getInternalFormat();
+                if (target == GL_TEXTURE_1D)
+                {
+                    glTexImage1D(target, level, internalFormat, width, 0, format, type, 0);
+                }
+                else if (target == GL_TEXTURE_2D)
+                {
+                    glTexImage2D(
+                        target, level, internalFormat, width, height, 0, format, type, 0);
+                }
+                else
+                {
+                    extensions->glTexImage3D(target, level, internalFormat, width, height,
+                        depth, 0, format, type, 0);
+                }
+            }
+
+            auto rows = static_cast<int>(std::max<std::size_t>(
+                1, (_streamBudget - std::min(bytes, _streamBudget)) / rowSize));
+            rows = std::min(rows, height - upload->row);
+            auto size = rows * rowSize;
+            auto src = image.getMipmapData(level) +
+                       (upload->slice * height + upload->row) * rowSize;
+
+            extensions->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, _pbos[_nextPbo]);
+            _nextPbo = (_nextPbo + 1) % _pbos.size();
+            extensions->glBufferData(
+                GL_PIXEL_UNPACK_BUFFER_ARB, size, 0, GL_STREAM_DRAW_ARB);
+            auto dst =
+                extensions->glMapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+            if (!dst)
+            {
+                OSG_FATAL << "Failed to map pixel buffer of " << _slots[upload->slot].file
+                          << std::endl;
+                break;
+            }
+            std::memcpy(dst, src, size);
+            extensions->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB);
+
+            if (target == GL_TEXTURE_1D)
+            {
+                glTexSubImage1D(target, level, 0, width, format, type, 0);
+            }
+            else if (target == GL_TEXTURE_2D)
+            {
+                glTexSubImage2D(
+                    target, level, 0, upload->row, width, rows, format, type, 0);
+            }
+            else
+            {
+                extensions->glTexSubImage3D(target, level, 0, upload->row, upload->slice,
+                    width, rows, 1, format, type, 0);
+            }
+            bytes += size;
+
+            upload->row += rows;
+            if (upload->row == height)
+            {
+                upload->row = 0;
+                if (++upload->slice == depth)
+                {
+                    upload->slice = 0;
+                    ++upload->level;
+                }
+            }
+        }
+
+        extensions->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+        if (upload->level == numLevels)
+        {
+            if (!image.isMipmap() && usesMipmaps(texture))
+            {
+                extensions->glGenerateMipmap(target);
+            }
+            texture.getTextureObject(contextId)->setAllocated(numLevels,
+                texture.getInternalFormat(), image.s(), image.t(), image.r(), 0);
+            upload->image = 0;
+            upload->resident = true;
+        }
+
+        if (bytes >= _streamBudget)
+        {
+            break;
+        }
+    }
+}
+
+osg::Image* TextureLoader::getPlaceholder()
+{
+    static osg::ref_ptr<osg::Image> image;
+    if (!image)
+    {
+        image = new osg::Image;
+        image->allocateImage(1, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+        std::memset(image->data(), 128, 4);
+    }
+    return image;
+}
+
+}  // namespace ntoy
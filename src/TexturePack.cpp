@@ -0,0 +1,337 @@
+#include <TexturePack.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <set>
+#include <sstream>
+
+#include <osg/Uniform>
+#include <osgDB/FileNameUtils>
+#include <osgDB/ReadFile>
+
+#include <StringUtil.h>
+#include <TextureLoader.h>
+#include <ThreadPool.h>
+
+namespace ntoy
+{
+
+namespace
+{
+
+auto includeSource = R"0(
+uniform sampler2DArray toy_Pack;
+// xy offset, zw size of each image in uv of its layer.
+uniform vec4 toy_PackRects[TOY_PACK_SIZE];
+uniform float toy_PackLayers[TOY_PACK_SIZE];
+
+// Sample image i of the pack at uv in [0, 1], uv is clamped to stay inside the image.
+vec4 toy_SamplePack(int i, vec2 uv)
+{
+    vec2 st = toy_PackRects[i].xy + clamp(uv, 0.0, 1.0) * toy_PackRects[i].zw;
+    return texture(toy_Pack, vec3(st, toy_PackLayers[i]));
+}
+)0";
+
+// Atlas layers are at least this large, so small images share few layers.
+const int minPageSize = 1024;
+
+// TOY_PACK_ define of file, e.g. TOY_PACK_ROCK_DIFFUSE for rock-diffuse.png.
+std::string getDefine(const std::string& file)
+{
+    auto name = sutil::toupper(osgDB::getStrippedName(file));
+    for (auto& c: name)
+    {
+        if (!std::isalnum(static_cast<unsigned char>(c)))
+        {
+            c = '_';
+        }
+    }
+    return "TOY_PACK_" + name;
+}
+
+int getNextPowerOfTwo(int v)
+{
+    auto p = 1;
+    while (p < v)
+    {
+        p *= 2;
+    }
+    return p;
+}
+
+bool hasSameLayout(const osg::Image& a, const osg::Image& b)
+{
+    return a.getPixelFormat() == b.getPixelFormat() && a.getDataType() == b.getDataType() &&
+           a.getInternalTextureFormat() == b.getInternalTextureFormat();
+}
+
+// Copy image into page at x, y, replicate its edge into a border of 1 pixel around it.
+void copyPadded(const osg::Image& image, osg::Image& page, int x, int y, bool convert)
+{
+    auto pixelSize = page.getPixelSizeInBits() / 8;
+    for (auto dy = -1; dy <= image.t(); ++dy)
+    {
+        auto sy = std::min(std::max(dy, 0), image.t() - 1);
+        for (auto dx = -1; dx <= image.s(); ++dx)
+        {
+            auto sx = std::min(std::max(dx, 0), image.s() - 1);
+            auto dst = page.data(x + 1 + dx, y + 1 + dy);
+            if (!convert)
+            {
+                std::memcpy(dst, image.data(sx, sy), pixelSize);
+                continue;
+            }
+
+            auto color = image.getColor(sx, sy);
+            for (auto i = 0; i < 4; ++i)
+            {
+                dst[i] = static_cast<unsigned char>(
+                    std::min(std::max(color[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+            }
+        }
+    }
+}
+
+}  // namespace
+
+const char* TexturePack::getIncludeName()
+{
+    return "ntoy/pack.glsl";
+}
+
+TexturePack::TexturePack() : _pool(new ThreadPool(1)) {}
+
+TexturePack::~TexturePack() = default;
+
+void TexturePack::addFile(const std::string& file)
+{
+    _files.push_back(file);
+}
+
+std::string TexturePack::getIncludeSource() const
+{
+    std::stringstream ss;
+    ss << "#pragma once\n";
+    ss << "#define TOY_PACK_SIZE " << _files.size() << "\n";
+
+    std::set<std::string> defines;
+    for (auto i = 0u; i < _files.size(); ++i)
+    {
+        auto define = getDefine(_files[i]);
+        if (!defines.insert(define).second)
+        {
+            OSG_WARN << "Pack already has " << define << ", use index " << i << " for "
+                     << _files[i] << std::endl;
+            continue;
+        }
+        ss << "#define " << define << " " << i << "\n";
+    }
+    ss << includeSource;
+    return ss.str();
+}
+
+void TexturePack::setup(osg::StateSet* stateSet, unsigned unit,
+    osg::Texture::FilterMode minFilter, osg::Texture::FilterMode magFilter)
+{
+    _stateSet = stateSet;
+    _unit = unit;
+    _minFilter = minFilter;
+    _magFilter = magFilter;
+
+    // every image is the gray placeholder until the first pack is done.
+    Packed placeholder;
+    placeholder.layers.push_back(TextureLoader::getPlaceholder());
+    placeholder.rects.assign(_files.size(), osg::Vec4(0, 0, 1, 1));
+    placeholder.layerIndices.assign(_files.size(), 0);
+
+    auto size = static_cast<unsigned>(_files.size());
+    _rectsUniform = new osg::Uniform(osg::Uniform::FLOAT_VEC4, "toy_PackRects", size);
+    _layersUniform = new osg::Uniform(osg::Uniform::FLOAT, "toy_PackLayers", size);
+    _stateSet->setDataVariance(osg::Object::DYNAMIC);
+    _stateSet->addUniform(new osg::Uniform("toy_Pack", static_cast<int>(unit)));
+    _stateSet->addUniform(_rectsUniform);
+    _stateSet->addUniform(_layersUniform);
+    bind(placeholder);
+
+    start();
+}
+
+bool TexturePack::update()
+{
+    auto changed = false;
+    if (_job.valid() &&
+        _job.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        auto packed = _job.get();
+        auto& layer = *packed.layers.front();
+        OSG_NOTICE << "Packed " << _files.size() << " images into "
+                   << packed.layers.size() << " layers of " << layer.s() << "x"
+                   << layer.t() << (packed.atlas ? " atlas" : "") << std::endl;
+        bind(packed);
+        changed = true;
+    }
+
+    if (_reloadRequested && !_job.valid())
+    {
+        _reloadRequested = false;
+        start();
+    }
+    return changed;
+}
+
+TexturePack::Packed TexturePack::pack(const std::vector<std::string>& files)
+{
+    std::vector<osg::ref_ptr<osg::Image>> images;
+    for (auto& file: files)
+    {
+        osg::ref_ptr<osg::Image> image = osgDB::readImageFile(file);
+        if (!image)
+        {
+            OSG_WARN << "Failed to load " << file << std::endl;
+            image = TextureLoader::getPlaceholder();
+        }
+        else if (image->isCompressed() || image->r() != 1)
+        {
+            OSG_WARN << "Can't pack " << file << ", it's compressed or not 2d."
+                     << std::endl;
+            image = TextureLoader::getPlaceholder();
+        }
+        images.push_back(image);
+    }
+
+    Packed packed;
+    auto& first = *images.front();
+    auto sameLayout = std::all_of(images.begin(), images.end(),
+        [&first](const osg::ref_ptr<osg::Image>& image) {
+            return hasSameLayout(*image, first);
+        });
+    auto sameSize = sameLayout && std::all_of(images.begin(), images.end(),
+        [&first](const osg::ref_ptr<osg::Image>& image) {
+            return image->s() == first.s() && image->t() == first.t();
+        });
+
+    // one layer per image, nothing to copy.
+    if (sameSize)
+    {
+        for (auto i = 0u; i < images.size(); ++i)
+        {
+            packed.layers.push_back(images[i]);
+            packed.rects.emplace_back(0, 0, 1, 1);
+            packed.layerIndices.push_back(static_cast<float>(i));
+        }
+        return packed;
+    }
+
+    // shelf pack tallest images first, start a new layer when a shelf doesn't fit.
+    auto maxSize = 0;
+    for (auto& image: images)
+    {
+        maxSize = std::max(maxSize, std::max(image->s(), image->t()) + 2);
+    }
+    auto pageSize = std::max(minPageSize, getNextPowerOfTwo(maxSize));
+
+    std::vector<unsigned> order(images.size());
+    for (auto i = 0u; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+        [&images](unsigned a, unsigned b) { return images[a]->t() > images[b]->t(); });
+
+    auto convert = !sameLayout;
+    auto addPage = [&]() {
+        osg::ref_ptr<osg::Image> page = new osg::Image;
+        if (convert)
+        {
+            page->allocateImage(pageSize, pageSize, 1, GL_RGBA, GL_UNSIGNED_BYTE, 1);
+            page->setInternalTextureFormat(GL_RGBA8);
+        }
+        else
+        {
+            page->allocateImage(
+                pageSize, pageSize, 1, first.getPixelFormat(), first.getDataType(), 1);
+            page->setInternalTextureFormat(first.getInternalTextureFormat());
+        }
+        std::memset(page->data(), 0, page->getTotalSizeInBytes());
+        packed.layers.push_back(page);
+    };
+
+    packed.atlas = true;
+    packed.rects.resize(images.size());
+    packed.layerIndices.resize(images.size());
+    addPage();
+    auto x = 0;
+    auto y = 0;
+    auto shelfHeight = 0;
+    for (auto i: order)
+    {
+        auto& image = *images[i];
+        auto w = image.s() + 2;
+        auto h = image.t() + 2;
+        if (x + w > pageSize)
+        {
+            x = 0;
+            y += shelfHeight;
+            shelfHeight = 0;
+        }
+        if (y + h > pageSize)
+        {
+            addPage();
+            x = 0;
+            y = 0;
+            shelfHeight = 0;
+        }
+
+        copyPadded(image, *packed.layers.back(), x, y, convert);
+        packed.rects[i].set(static_cast<float>(x + 1) / pageSize,
+            static_cast<float>(y + 1) / pageSize, static_cast<float>(image.s()) / pageSize,
+            static_cast<float>(image.t()) / pageSize);
+        packed.layerIndices[i] = static_cast<float>(packed.layers.size() - 1);
+        x += w;
+        shelfHeight = std::max(shelfHeight, h);
+    }
+    return packed;
+}
+
+void TexturePack::start()
+{
+    auto files = _files;
+    _job = _pool->submit([files]() { return pack(files); });
+}
+
+void TexturePack::bind(const Packed& packed)
+{
+    auto& first = *packed.layers.front();
+    // mipmaps would bleed neighbours of an atlas into each other.
+    auto minFilter = _minFilter;
+    if (packed.atlas && minFilter != osg::Texture::NEAREST)
+    {
+        minFilter = minFilter == osg::Texture::NEAREST_MIPMAP_NEAREST ||
+                            minFilter == osg::Texture::NEAREST_MIPMAP_LINEAR
+                        ? osg::Texture::NEAREST
+                        : osg::Texture::LINEAR;
+    }
+
+    auto texture = new osg::Texture2DArray;
+    texture->setTextureSize(first.s(), first.t(), static_cast<int>(packed.layers.size()));
+    for (auto i = 0u; i < packed.layers.size(); ++i)
+    {
+        texture->setImage(i, packed.layers[i]);
+    }
+    texture->setResizeNonPowerOfTwoHint(false);
+    texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+    texture->setFilter(osg::Texture::MIN_FILTER, minFilter);
+    texture->setFilter(osg::Texture::MAG_FILTER, _magFilter);
+    _stateSet->setTextureAttribute(_unit, texture);
+
+    for (auto i = 0u; i < packed.rects.size(); ++i)
+    {
+        _rectsUniform->setElement(i, packed.rects[i]);
+        _layersUniform->setElement(i, packed.layerIndices[i]);
+    }
+}
+
+}  // namespace ntoy
@@ -0,0 +1,73 @@
+#include <ThreadPool.h>
+
+#include <algorithm>
+
+namespace ntoy
+{
+
+ThreadPool::ThreadPool(unsigned numThreads)
+{
+    if (numThreads == 0)
+    {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (auto i = 0u; i < numThreads; ++i)
+    {
+        _threads.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _done = true;
+    }
+    _condition.notify_all();
+
+    for (auto& thread: _threads)
+    {
+        thread.join();
+    }
+}
+
+unsigned ThreadPool::getNumPendingJobs() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return static_cast<unsigned>(_jobs.size()) + _numRunningJobs;
+}
+
+void ThreadPool::push(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.push_back(std::move(job));
+    }
+    _condition.notify_one();
+}
+
+void ThreadPool::work()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _condition.wait(lock, [this] { return _done || !_jobs.empty(); });
+        if (_jobs.empty())
+        {
+            return;
+        }
+
+        auto job = std::move(_jobs.front());
+        _jobs.pop_front();
+        ++_numRunningJobs;
+
+        lock.unlock();
+        job();
+        lock.lock();
+
+        --_numRunningJobs;
+    }
+}
+
+}  // namespace ntoy
@@ -0,0 +1,164 @@
+#include <TileWriter.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <osg/Endian>
+#include <osgDB/FileNameUtils>
+#include <osgDB/WriteFile>
+
+#include <StringUtil.h>
+
+namespace ntoy
+{
+
+namespace
+{
+
+bool isLittleEndian()
+{
+    return osg::getCpuByteOrder() == osg::LittleEndian;
+}
+
+}  // namespace
+
+TileWriter::TileWriter(const std::string& file, int width, int height, GLenum pixelFormat,
+    GLenum pixelType, int numTiles)
+    : _file(file), _width(width), _height(height), _remainingTiles(numTiles)
+{
+    _pixelSize = osg::Image::computePixelSizeInBits(pixelFormat, pixelType) / 8;
+    auto channels = osg::Image::computeNumComponents(pixelFormat);
+
+    std::stringstream header;
+    if (canStream(file, pixelFormat, pixelType))
+    {
+        auto ext = sutil::tolower(osgDB::getFileExtension(file));
+        if (ext == "pfm")
+        {
+            // negative scale means little endian
+            _format = PFM;
+            header << (channels == 3 ? "PF" : "Pf") << "\n"
+                   << width << " " << height << "\n"
+                   << (isLittleEndian() ? "-1.0" : "1.0") << "\n";
+        }
+        else if (ext == "ppm" || ext == "pgm")
+        {
+            _format = PNM;
+            header << (channels == 3 ? "P6" : "P5") << "\n"
+                   << width << " " << height << "\n"
+                   << (pixelType == GL_UNSIGNED_SHORT ? 65535 : 255) << "\n";
+        }
+        else
+        {
+            _format = RAW;
+        }
+    }
+
+    if (_format == OTHER)
+    {
+        OSG_NOTICE << file << " can't be streamed, it's assembled in memory." << std::endl;
+        _image = new osg::Image;
+        _image->allocateImage(width, height, 1, pixelFormat, pixelType, 1);
+        return;
+    }
+
+    // full size file, tiles are written in place.
+    auto headerString = header.str();
+    _headerSize = headerString.size();
+    std::ofstream ofs(file, std::ios::binary | std::ios::trunc);
+    ofs.write(headerString.data(), headerString.size());
+    ofs.seekp(_headerSize + _pixelSize * width * height - 1);
+    ofs.put(0);
+    if (!ofs)
+    {
+        throw std::runtime_error("Failed to create " + file);
+    }
+}
+
+bool TileWriter::writeTile(int x, int y, const osg::Image& tile)
+{
+    auto written = _format == OTHER ? copyTile(x, y, tile) : streamTile(x, y, tile);
+
+    if (--_remainingTiles == 0 && _image)
+    {
+        written &= osgDB::writeImageFile(*_image, _file);
+        _image = 0;
+    }
+
+    return written;
+}
+
+bool TileWriter::canStream(const std::string& file, GLenum pixelFormat, GLenum pixelType)
+{
+    auto ext = sutil::tolower(osgDB::getFileExtension(file));
+    auto channels = osg::Image::computeNumComponents(pixelFormat);
+    auto byteOrShort = pixelType == GL_UNSIGNED_BYTE || pixelType == GL_UNSIGNED_SHORT;
+
+    if (ext == "pfm")
+    {
+        return pixelType == GL_FLOAT && (channels == 1 || channels == 3);
+    }
+    if (ext == "ppm")
+    {
+        return channels == 3 && byteOrShort;
+    }
+    if (ext == "pgm")
+    {
+        return channels == 1 && byteOrShort;
+    }
+    return ext == "raw";
+}
+
+bool TileWriter::streamTile(int x, int y, const osg::Image& tile)
+{
+    std::fstream fs(_file, std::ios::binary | std::ios::in | std::ios::out);
+    if (!fs)
+    {
+        return false;
+    }
+
+    // 16 bit pnm is big endian
+    auto swap = _format == PNM && _pixelSize % 2 == 0 && isLittleEndian();
+    auto rowSize = _pixelSize * tile.s();
+    std::vector<char> row(rowSize);
+
+    for (auto r = 0; r < tile.t(); ++r)
+    {
+        // pnm rows are top down, pfm and raw are bottom up as GL.
+        auto fileRow = _format == PNM ? _height - 1 - (y + r) : y + r;
+        auto offset =
+            _headerSize + (static_cast<std::size_t>(fileRow) * _width + x) * _pixelSize;
+
+        auto data = reinterpret_cast<const char*>(tile.data(0, r));
+        if (swap)
+        {
+            for (auto i = 0u; i + 1 < rowSize; i += 2)
+            {
+                row[i] = data[i + 1];
+                row[i + 1] = data[i];
+            }
+            data = row.data();
+        }
+
+        fs.seekp(offset);
+        fs.write(data, rowSize);
+    }
+
+    return static_cast<bool>(fs);
+}
+
+bool TileWriter::copyTile(int x, int y, const osg::Image& tile)
+{
+    auto rowSize = _pixelSize * tile.s();
+    for (auto r = 0; r < tile.t(); ++r)
+    {
+        std::memcpy(_image->data(x, y + r), tile.data(0, r), rowSize);
+    }
+    return true;
+}
+
+}  // namespace ntoy
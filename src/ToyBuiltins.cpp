@@ -0,0 +1,131 @@
+#include <ToyBuiltins.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+
+#include <osg/BufferObject>
+#include <osg/FrameStamp>
+#include <osg/GLExtensions>
+#include <osg/Program>
+#include <osg/State>
+
+namespace ntoy
+{
+
+namespace
+{
+
+const char* blockName = "ToyBuiltins";
+
+auto blockSource = R"0(layout(std140) uniform ToyBuiltins
+{
+    vec4 toy_Resolution;            // width, height, 1 / width, 1 / height
+    vec4 toy_Mouse;                 // xy of pointer, xy of last button push
+    vec4 toy_Date;                  // year, month starts from 0, day, seconds of day
+    vec4 toy_ChannelResolution[4];  // size of texture unit 0 to 3
+    float toy_Time;                 // simulation time
+    float toy_TimeDelta;
+    int toy_Frame;
+    float toy_FrameRate;
+};
+)0";
+
+void setVec4(float* dst, float x, float y, float z, float w)
+{
+    dst[0] = x;
+    dst[1] = y;
+    dst[2] = z;
+    dst[3] = w;
+}
+
+}  // namespace
+
+const char* ToyBuiltins::getBlockSource()
+{
+    return blockSource;
+}
+
+void ToyBuiltins::bindProgram(osg::Program& program)
+{
+    program.addBindUniformBlock(blockName, binding);
+}
+
+ToyBuiltins::ToyBuiltins()
+{
+    static_assert(sizeof(Block) == 128, "Block must match std140 layout");
+
+    _data = new osg::UByteArray(sizeof(Block));
+    auto ubo = new osg::UniformBufferObject;
+    ubo->setUsage(GL_DYNAMIC_DRAW);
+    _data->setBufferObject(ubo);
+
+    _binding = new osg::UniformBufferBinding(binding, _data.get(), 0, sizeof(Block));
+    _binding->setDataVariance(osg::Object::DYNAMIC);
+}
+
+osg::StateAttribute* ToyBuiltins::getBinding()
+{
+    return _binding;
+}
+
+void ToyBuiltins::setChannelResolution(unsigned channel, const osg::Vec3& resolution)
+{
+    _channelResolutions[channel] = resolution;
+}
+
+void ToyBuiltins::update(const osg::FrameStamp& frameStamp)
+{
+    Block block;
+
+    auto width = _resolution.x();
+    auto height = _resolution.y();
+    setVec4(block.resolution, width, height, width > 0 ? 1 / width : 0,
+        height > 0 ? 1 / height : 0);
+    auto mouse = _mouse * _mouseScale;
+    auto click = _mouseClick * _mouseScale;
+    setVec4(block.mouse, mouse.x(), mouse.y(), click.x(), click.y());
+
+    auto now = std::chrono::system_clock::now();
+    auto t = std::chrono::system_clock::to_time_t(now);
+    auto fraction = std::chrono::duration<float>(
+        now - std::chrono::system_clock::from_time_t(t)).count();
+    auto tm = *std::localtime(&t);
+    setVec4(block.date, tm.tm_year + 1900, tm.tm_mon, tm.tm_mday,
+        tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec + fraction);
+
+    for (auto i = 0; i < 4; ++i)
+    {
+        auto& v = _channelResolutions[i];
+        setVec4(block.channelResolution[i], v.x(), v.y(), v.z(), 0);
+    }
+
+    auto time = frameStamp.getSimulationTime();
+    auto delta = _lastTime < 0 ? 0 : time - _lastTime;
+    _lastTime = time;
+    block.time = time;
+    block.timeDelta = delta;
+    block.frame = frameStamp.getFrameNumber();
+    block.frameRate = delta > 0 ? 1 / delta : 0;
+
+    std::memcpy(&_data->front(), &block, sizeof(block));
+    _data->dirty();
+}
+
+void ToyBuiltins::latchMouse(osg::State& state, const osg::Vec2& mouse)
+{
+    auto bo = _data->getBufferObject()->getGLBufferObject(state.getContextID());
+    if (!bo || bo->isDirty())
+    {
+        return;
+    }
+
+    float xy[2] = {mouse.x() * _mouseScale, mouse.y() * _mouseScale};
+    bo->bindBuffer();
+    state.get<osg::GLExtensions>()->glBufferSubData(GL_UNIFORM_BUFFER,
+        bo->getOffset(_data->getBufferIndex()) + offsetof(Block, mouse), sizeof(xy), xy);
+    bo->unbindBuffer();
+}
+
+}  // namespace ntoy
@@ -1,11 +1,26 @@
 #include <ToyViewer.h>
 
-#include <osgGA/TrackballManipulator>
+#include <fstream>
+#include <map>
+
+#include <osg/GraphicsContext>
+#include <osg/Viewport>
 #include <osg/os_utils>
+#include <osgGA/TrackballManipulator>
+
+#ifdef NTOY_X11
+// Xlib macros leak, keep it last.
+#    include <osgViewer/api/X11/GraphicsWindowX11>
+#endif
 
 namespace toy
 {
 
+ToyViewer::~ToyViewer()
+{
+    stopThreading();
+}
+
 int ToyViewer::run()
 {
     if (!getCameraManipulator() && getCamera()->getAllowEventFocus())
@@ -13,6 +28,11 @@ int ToyViewer::run()
         setCameraManipulator(new osgGA::TrackballManipulator());
     }
 
+    if (_bench.measuredFrames > 0)
+    {
+        return runBench();
+    }
+
     if (!isRealized())
     {
         realize();
@@ -24,10 +44,57 @@ int ToyViewer::run()
     auto lastTick = osg::Timer::instance()->tick();
     double simulationTime = 0;
 
+    // nothing to wait for without window, don't throttle.
+    if (_headless)
+    {
+        while (!done() && (runTillFrameNumber == osg::UNINITIALIZED_FRAME_NUMBER ||
+                              getViewerFrameStamp()->getFrameNumber() < runTillFrameNumber))
+        {
+            auto startFrameTick = osg::Timer::instance()->tick();
+            if (!_pause || _debugSteps > 0)
+            {
+                simulationTime += osg::Timer::instance()->delta_s(lastTick, startFrameTick);
+                --_debugSteps;
+            }
+            lastTick = startFrameTick;
+            frame(simulationTime);
+            if (_profiler)
+            {
+                _profiler->update(*this);
+            }
+        }
+
+        if (_profiler)
+        {
+            _profiler->finish(*this);
+        }
+        return 0;
+    }
+
+    addInputFileDescriptors();
+
+    auto deadline = _pacer.now();
     while (!done() && (runTillFrameNumber == osg::UNINITIALIZED_FRAME_NUMBER ||
                           getViewerFrameStamp()->getFrameNumber() < runTillFrameNumber))
     {
-        double minFrameTime = _runMaxFrameRate > 0.0 ? 1.0 / _runMaxFrameRate : 0.0;
+        // block until input, observed file change or requested wake instead of polling.
+        if (_runFrameScheme == ON_DEMAND && !checkNeedToDoFrame())
+        {
+            _pacer.wait();
+
+            // a wake without input, e.g. a stat poll, a compile check or an ignored file
+            // event, might change nothing. Poll without advancing the frame stamp, so
+            // frame number and everything keyed by it move only with drawn frames.
+            if (_pollCallback && !checkNeedToDoFrame())
+            {
+                _pollCallback();
+                if (!checkNeedToDoFrame())
+                {
+                    continue;
+                }
+            }
+        }
+
         osg::Timer_t startFrameTick = osg::Timer::instance()->tick();
         if (!_pause || _debugSteps > 0)
         {
@@ -41,36 +108,266 @@ int ToyViewer::run()
 
         lastTick = startFrameTick;
 
-        if (_runFrameScheme == ON_DEMAND)
+        frame(simulationTime);
+
+        if (_profiler)
+        {
+            _profiler->update(*this);
+        }
+
+        // hold back the frame rate with absolute deadlines, a late frame resets the
+        // deadline instead of being caught up by a burst.
+        if (_runMaxFrameRate > 0.0)
         {
-            if (checkNeedToDoFrame())
+            deadline += 1.0 / _runMaxFrameRate;
+            auto now = _pacer.now();
+            if (deadline < now)
             {
-                frame(simulationTime);
+                deadline = now;
             }
             else
             {
-                // we don't need to render a frame but we don't want to spin the run loop so
-                // make sure the minimum loop time is 1/100th of second, if not otherwise
-                // set, so enabling the frame microSleep below to avoid consume excessive
-                // CPU resources.
-                if (minFrameTime == 0.0)
-                    minFrameTime = 0.01;
+                _pacer.sleepUntil(deadline);
             }
         }
-        else
+    }
+
+    if (_profiler)
+    {
+        _profiler->finish(*this);
+    }
+
+    return 0;
+}
+
+bool ToyViewer::checkNeedToDoFrame()
+{
+    if (_requestRedraw || _requestContinousUpdate || !_pause || _debugSteps > 0)
+    {
+        return true;
+    }
+
+    if (_needFrameCallback && _needFrameCallback())
+    {
+        return true;
+    }
+
+    auto manipulator = getCameraManipulator();
+    if (manipulator && manipulator->getInverseMatrix() != getCamera()->getViewMatrix())
+    {
+        return true;
+    }
+
+    return checkEvents();
+}
+
+void ToyViewer::addInputFileDescriptors()
+{
+#ifdef NTOY_X11
+    Windows windows;
+    getWindows(windows);
+    for (auto window: windows)
+    {
+        auto x11Window = dynamic_cast<osgViewer::GraphicsWindowX11*>(window);
+        if (x11Window && x11Window->getEventDisplay())
         {
-            frame(simulationTime);
+            _pacer.addFileDescriptor(ConnectionNumber(x11Window->getEventDisplay()));
         }
+    }
+#endif
+}
 
-        // work out if we need to force a sleep to hold back the frame rate
-        osg::Timer_t endFrameTick = osg::Timer::instance()->tick();
-        double frameTime = osg::Timer::instance()->delta_s(startFrameTick, endFrameTick);
-        if (frameTime < minFrameTime)
-            OpenThreads::Thread::microSleep(
-                static_cast<unsigned int>(1000000.0 * (minFrameTime - frameTime)));
+bool ToyViewer::startProfiler(const std::string& file)
+{
+    try
+    {
+        _profiler.reset(new FrameProfiler(file));
+        return true;
+    }
+    catch (const std::runtime_error& e)
+    {
+        OSG_FATAL << e.what() << std::endl;
+        return false;
     }
+}
 
-    return 0;
+int ToyViewer::runBench()
+{
+    // keep context current, glFinish right after each frame.
+    setThreadingModel(SingleThreaded);
+    setReleaseContextAtEndOfFrameHint(false);
+
+    if (!isRealized())
+    {
+        realize();
+    }
+
+    Windows windows;
+    getWindows(windows);
+    for (auto window: windows)
+    {
+        window->setSyncToVBlank(false);
+    }
+
+    Contexts contexts;
+    getContexts(contexts);
+
+    auto timer = osg::Timer::instance();
+    auto simulationTime = 0.0;
+    auto warmupFrames = 0;
+    std::vector<double> frameTimes;
+    frameTimes.reserve(_bench.measuredFrames);
+
+    while (!done() && static_cast<int>(frameTimes.size()) < _bench.measuredFrames)
+    {
+        auto startTick = timer->tick();
+        frame(simulationTime);
+        for (auto gc: contexts)
+        {
+            gc->makeCurrent();
+            glFinish();
+        }
+        auto frameTime = timer->delta_m(startTick, timer->tick());
+        simulationTime += _bench.dt;
+
+        if (_profiler)
+        {
+            _profiler->update(*this);
+        }
+
+        if (_bench.ready && !_bench.ready())
+        {
+            continue;
+        }
+
+        if (warmupFrames < _bench.warmupFrames)
+        {
+            ++warmupFrames;
+            continue;
+        }
+
+        frameTimes.push_back(frameTime);
+    }
+
+    if (_profiler)
+    {
+        _profiler->finish(*this);
+    }
+
+    if (static_cast<int>(frameTimes.size()) < _bench.measuredFrames)
+    {
+        OSG_FATAL << "Bench stopped after " << frameTimes.size() << " measured frames."
+                  << std::endl;
+        return 1;
+    }
+
+    return reportBench(frameTimes);
+}
+
+int ToyViewer::reportBench(const std::vector<double>& frameTimes)
+{
+    auto summary = summarize(frameTimes);
+    OSG_NOTICE << "Bench " << summary.count << " frames, min " << summary.min << " ms, median "
+               << summary.p50 << " ms, p99 " << summary.p99 << " ms" << std::endl;
+
+    const std::pair<const char*, double> results[] = {
+        {"min", summary.min}, {"median", summary.p50}, {"p99", summary.p99}};
+
+    if (!_bench.saveFile.empty())
+    {
+        std::ofstream ofs(_bench.saveFile);
+        for (auto& result: results)
+        {
+            ofs << result.first << " " << result.second << "\n";
+        }
+
+        if (!ofs)
+        {
+            OSG_FATAL << "Failed to write " << _bench.saveFile << std::endl;
+            return 1;
+        }
+    }
+
+    if (_bench.baselineFile.empty())
+    {
+        return 0;
+    }
+
+    // lines of name value
+    std::ifstream ifs(_bench.baselineFile);
+    if (!ifs)
+    {
+        OSG_FATAL << "Failed to read " << _bench.baselineFile << std::endl;
+        return 1;
+    }
+
+    std::map<std::string, double> baseline;
+    std::string name;
+    double value;
+    while (ifs >> name >> value)
+    {
+        baseline[name] = value;
+    }
+
+    auto exitCode = 0;
+    for (auto& result: results)
+    {
+        // min is too noisy to gate on.
+        auto iter = baseline.find(result.first);
+        if (result.first == std::string("min") || iter == baseline.end())
+        {
+            continue;
+        }
+
+        auto limit = iter->second * (1.0 + _bench.tolerance / 100.0);
+        if (result.second > limit)
+        {
+            OSG_FATAL << result.first << " " << result.second << " ms exceeds baseline "
+                      << iter->second << " ms by more than " << _bench.tolerance << "%"
+                      << std::endl;
+            exitCode = 2;
+        }
+    }
+    return exitCode;
+}
+
+bool ToyViewer::setUpHeadless(int width, int height)
+{
+    osg::ref_ptr<osg::GraphicsContext::Traits> traits = new osg::GraphicsContext::Traits;
+    traits->readDISPLAY();
+    traits->setUndefinedScreenDetailsToDefaultScreen();
+    traits->x = 0;
+    traits->y = 0;
+    traits->width = width;
+    traits->height = height;
+    traits->pbuffer = true;
+    traits->doubleBuffer = false;
+    traits->windowDecoration = false;
+    traits->sharedContext = 0;
+
+    osg::ref_ptr<osg::GraphicsContext> gc =
+        osg::GraphicsContext::createGraphicsContext(traits.get());
+    if (!gc)
+    {
+        OSG_FATAL << "Failed to create " << width << "x" << height << " pbuffer." << std::endl;
+        return false;
+    }
+
+    auto camera = getCamera();
+    camera->setGraphicsContext(gc.get());
+    camera->setViewport(new osg::Viewport(0, 0, width, height));
+    camera->setProjectionMatrixAsPerspective(
+        30.0, static_cast<double>(width) / height, 1.0, 10000.0);
+
+    // single buffered, there is no swap.
+    camera->setDrawBuffer(GL_FRONT);
+    camera->setReadBuffer(GL_FRONT);
+
+    // no window, no window events to check or to wait for.
+    setThreadingModel(SingleThreaded);
+    setKeyEventSetsDone(0);
+    _headless = true;
+    return true;
 }
 
 bool ViewerDebugHandler::handle(
@@ -6,6 +6,7 @@
 #include <osgViewer/ViewerEventHandlers>
 
 #include <NodeToy.h>
+#include <Resource.h>
 #include <ToyViewer.h>
 
 namespace ntoy
@@ -33,6 +34,18 @@ bool NodeToyEventHandler::handle(
         case osgGA::GUIEventAdapter::KEYDOWN:
             switch (ea.getKey())
             {
+                case osgGA::GUIEventAdapter::KEY_F5:
+                    _toy->toggleLatencyOverlay();
+                    break;
+
+                case osgGA::GUIEventAdapter::KEY_F7:
+                    _toy->switchVariant(-1);
+                    break;
+
+                case osgGA::GUIEventAdapter::KEY_F8:
+                    _toy->switchVariant(1);
+                    break;
+
                 case osgGA::GUIEventAdapter::KEY_F11:
                     _toy->reportBound();
                     break;
@@ -51,7 +64,12 @@ bool NodeToyEventHandler::handle(
             break;
 
         case osgGA::GUIEventAdapter::MOVE:
-            _toy->updateMouse(osg::Vec2(ea.getX(), ea.getY()));
+        case osgGA::GUIEventAdapter::DRAG:
+            _toy->updateMouse(osg::Vec2(ea.getX(), ea.getY()), ea.getTime());
+            break;
+
+        case osgGA::GUIEventAdapter::PUSH:
+            _toy->clickMouse(osg::Vec2(ea.getX(), ea.getY()));
             break;
 
         case osgGA::GUIEventAdapter::RESIZE:
@@ -59,17 +77,30 @@ bool NodeToyEventHandler::handle(
             break;
 
         case osgGA::GUIEventAdapter::FRAME:
+        {
+            auto viewer = dynamic_cast<osgViewer::Viewer*>(&aa);
+            if (!viewer)
+            {
+                break;
+            }
+
             if (_toy->getExportTextures())
             {
-                auto viewer = dynamic_cast<osgViewer::Viewer*>(&aa);
-                if (viewer && viewer->getFrameStamp()->getFrameNumber() >= 2)
+                if (_toy->exportTextures())
                 {
-                    _toy->exportTextures();
                     _toy->getRoot()->setNodeMask(0);
                     viewer->getEventQueue()->quitApplication();
                 }
             }
+            else if (!_toy->getScreenshotFile().empty())
+            {
+                if (_toy->screenshot())
+                {
+                    viewer->getEventQueue()->quitApplication();
+                }
+            }
             break;
+        }
         default:
             break;
     }
@@ -103,13 +134,90 @@ int main(int argc, char* argv[])
   Create program with x.vert and y.frag, use it to render mesh.osgt. Observing x.vert,
   y.frag, mesh.osgt, reload if changed.
 
+  Shaders can #include "file" or #pragma include "file", included files are observed too,
+  only shaders that depend on the changed file are reloaded.
+
+  Shaders with #version 140 or later can read time, mouse, resolution, date and texture
+  sizes from uniform block ToyBuiltins, it's written once per frame. Its declaration is in
+  the toy.frag created by --shadertoy. Uniforms mouse and resolution are still set for
+  older shaders.
+
+  In shadertoy mode the pointer is sampled again right before the quad is drawn, press F5
+  to show how old mouse input is when it's drawn and presented.
+
   ntoy --export-texture script
 
   Export shader textures, each line of script is an export item:
      output_name frag s t pixel_format pixel_type packing
 
   pixel_format and pixel_type is literal enum without the GL_ prefix, it's case insensitive. Note it
-  always overwrite existing file.
+  always overwrite existing file. Items are rendered in waves of --export-wave cameras, images
+  are written by a thread pool while next wave renders.
+
+  Items larger than --export-tile are rendered tile by tile, resolution is the size of the
+  whole item and tileOrigin is the offset of the tile, use
+  (gl_FragCoord.xy + tileOrigin) / resolution as uv. Tiles of pfm, ppm, pgm and raw files
+  are written straight into the file, other formats are assembled in memory.
+
+  ntoy --headless --frag fun.frag --shadertoy --screenshot fun.png
+
+  Render offscreen without window, write fun.png once the scene is loaded, then quit.
+  --headless works with --export-texture too.
+
+  ntoy --shadertoy --frag fun.frag --bench 100 500 --bench-baseline fun.bench
+
+  Render fun.frag headless for 100 warm up frames and 500 measured frames, exit with 2 if
+  median or p99 frame time is 5% slower than the one saved in fun.bench by --bench-save.
+
+  ntoy --shadertoy --frag fun.frag --variant "QUALITY=0|1|2" --variant FOG --profile fun.csv
+
+  Link all 6 combinations of QUALITY and FOG in background, press F7 or F8 to switch
+  between them without relinking, the frame of each switch is logged.
+
+  ntoy --shadertoy --frag path.frag --accumulate 4096 --accumulate-bands 4
+
+  Blend each frame of path.frag into the mean of all previous ones, a quarter of the screen
+  per frame, until 4096 samples. Shader reads sample index from int uniform
+  toy_SampleIndex. Time starts paused, moving mouse, resizing, F9, variant switch or any
+  observed file change starts over.
+
+  ntoy --shadertoy --frag heavy.frag --dynamic-resolution 16
+
+  Render heavy.frag at a fraction of the window size, the fraction follows gpu time of the
+  quad towards 16 ms, upscale it to the window. resolution and mouse are in scaled pixels,
+  --dynamic-resolution-filter sharp sharpens the upscaled image without halos.
+
+  ntoy --shadertoy --frag f.frag --texture2d big.png linear_mipmap_linear linear clamp clamp
+
+  Window shows up at once, textures are gray until their images are decoded on a thread
+  pool, mipmaps of 8 bit and float images are generated there too.
+  big.png is observed, a changed image is streamed into a new texture a few MiB per
+  frame, the old one is drawn until the new one is complete.
+
+  ntoy --brick-volume ct.raw 2048 2048 1024 red unsigned_short ct.bvol
+  ntoy --shadertoy --frag march.frag --texture3d ct.bvol linear linear clamp clamp clamp
+
+  Volumes too large for memory are cut into bricks once, then streamed from the memory
+  mapped .bvol. march.frag has #version 420, #include <ntoy/bricked_volume.glsl> and
+  samples with toy_SampleVolume(p). Bricks it touches are loaded into an atlas of
+  --brick-cache MiB, least recently used ones are evicted, the page table is on unit 15.
+
+  ntoy --shadertoy --frag march.frag --min-max-unit 4 \
+       --texture3d fog.dds linear linear clamp clamp clamp
+
+  A min max pyramid of fog.dds is built on the loader thread, rebuilt when it's reloaded,
+  and bound to unit 4 as sampler3D toy_MinMax0 with float toy_MinMaxCell0 voxels per cell.
+  march.frag includes <ntoy/min_max.glsl>, toy_MinMax(toy_MinMax0, toy_MinMaxCell0, voxel,
+  level) returns min and max of the cell around voxel, toy_MinMaxExit returns the distance
+  to leave it, so empty cells are skipped in one step.
+
+  ntoy --shadertoy --frag f.frag --texture2d-pack rock.png --texture2d-pack moss.png \
+       --texture2d-pack-filter linear_mipmap_linear linear
+
+  Images of a pack share one sampler2DArray toy_Pack on unit 14. Same sized images are
+  layers of their own, mixed sizes are packed into atlas layers. f.frag includes
+  <ntoy/pack.glsl> and samples with toy_SamplePack(TOY_PACK_ROCK, uv), layers and rects
+  of the images are uniform arrays. Changing any image packs all of them again.
 
 )0";
     std::stringstream ss;
@@ -119,24 +227,103 @@ int main(int argc, char* argv[])
     usage->addKeyboardMouseBinding("F12", "Save.");
     usage->addKeyboardMouseBinding("F11", "Output bounding.");
     usage->addKeyboardMouseBinding("a", "Toggle axes.");
-
+    usage->addKeyboardMouseBinding("F5", "Toggle mouse latency overlay.");
+    usage->addKeyboardMouseBinding("F7", "Previous shader variant.");
+    usage->addKeyboardMouseBinding("F8", "Next shader variant.");
+
+    usage->addEnvironmentalVariable("NTOY_CACHE_DIR",
+        "Directory of program binary cache, default is $XDG_CACHE_HOME/ntoy or "
+        "$HOME/.cache/ntoy.");
+    usage->addEnvironmentalVariable("NTOY_FILE_WATCHER",
+        "Set to stat to poll observed files with stat instead of inotify.");
+
+    usage->addCommandLineOption("--accumulate",
+        "Accumulate shadertoy samples into a float texture and show their mean, stop "
+        "after optional max samples. Time starts paused.");
+    usage->addCommandLineOption("--accumulate-bands",
+        "Split the screen into bands for --accumulate, one band is drawn per frame. "
+        "Default 1.");
+    usage->addCommandLineOption("--brick-cache",
+        "MiB of the brick atlas of a .bvol --texture3d. Default 512.");
+    usage->addCommandLineOption("--brick-size",
+        "Voxels per side of a brick of --brick-volume. Default 32.");
+    usage->addCommandLineOption("--brick-volume",
+        "Cut a raw volume into bricks for --texture3d, then quit. e.g. --brick-volume "
+        "ct.raw 2048 2048 1024 red unsigned_short ct.bvol");
+    usage->addCommandLineOption("--dynamic-resolution",
+        "Render shadertoy quad at a scale of the window that follows its gpu time towards "
+        "target milliseconds, upscale it to the window. e.g. --dynamic-resolution 16");
+    usage->addCommandLineOption("--dynamic-resolution-filter",
+        "Upscale filter of --dynamic-resolution, bilinear or sharp. Default bilinear.");
+    usage->addCommandLineOption("--dynamic-resolution-min",
+        "Min scale of --dynamic-resolution. Default 0.25.");
     usage->addCommandLineOption("--export-texture",
         "Read in script, export textures. All other option ignored. "
         "See example for detail.");
+    usage->addCommandLineOption("--export-tile",
+        "Max width and height of an export tile, larger textures are tiled. Default 8192.");
+    usage->addCommandLineOption("--export-wave",
+        "Number of export textures rendered in the same frame. Default 8.");
+    usage->addCommandLineOption("--headless",
+        "Render into an offscreen pbuffer, no window is created.");
+    usage->addCommandLineOption("--headless-size",
+        "Width and height of the headless pbuffer. Default 1280 720.");
+    usage->addCommandLineOption("--min-max-cell",
+        "Voxels per side of a --min-max-unit cell. Default 8.");
+    usage->addCommandLineOption("--min-max-unit",
+        "Build a min max pyramid of every --texture3d image, bind the one of unit n to "
+        "this unit + n as sampler3D toy_MinMaxN.");
+    usage->addCommandLineOption("--screenshot",
+        "Write main camera to file once the scene is loaded, then quit.");
     usage->addCommandLineOption("--vert", "Observe vert shader.");
     usage->addCommandLineOption("--geom", "Observe geom shader.");
     usage->addCommandLineOption("--frag", "Observe frag shader.");
     usage->addCommandLineOption("--tesc", "Observe tesc shader.");
     usage->addCommandLineOption("--tese", "Observe tese shader.");
+    usage->addCommandLineOption("--buffer",
+        "Shadertoy buffer pass, A to D. e.g. --buffer A a.frag. Buffers are drawn in "
+        "order into double buffered float textures before the scene. Every pass reads "
+        "buffer X as sampler2D toy_BufferX on unit 8 to 11, it's this frame's output if X "
+        "is drawn before the pass, last frame's otherwise.");
     usage->addCommandLineOption("--comp", "Observe comp shader.");
     usage->addCommandLineOption("--shader", "Observe shader.");
+    usage->addCommandLineOption("--bench",
+        "Render warm up frames and measured frames headless, with fixed time step, vsync "
+        "off and glFinish after each frame. Print min, median and p99 frame time. e.g. "
+        "--bench 100 500");
+    usage->addCommandLineOption("--bench-baseline",
+        "Exit with 2 if bench median or p99 exceeds the one in this file by more than "
+        "--bench-tolerance percent.");
+    usage->addCommandLineOption("--bench-dt", "Bench simulation time step. Default 1/60.");
+    usage->addCommandLineOption("--bench-save", "Write bench result as baseline file.");
+    usage->addCommandLineOption("--bench-tolerance",
+        "Percent bench can exceed baseline. Default 5.");
+    usage->addCommandLineOption("--continuous",
+        "Draw every frame. By default a frame is only drawn if time moves, input "
+        "arrives, camera moves or an observed file changes, nothing is drawn while "
+        "paused by F9 and idle.");
     usage->addCommandLineOption("--define",
         "Add define to osg::StateSet. e.g. --define NAME --define \"NAME=X Y Z\"");
+    usage->addCommandLineOption("--variant",
+        "Values of a variant define separated by |, a bare name means undefined or "
+        "defined. Every combination of variant defines is linked in background, F7 and "
+        "F8 switch between them. e.g. --variant \"QUALITY=0|1|2\" --variant FOG");
     usage->addCommandLineOption("--shadertoy",
         "Shader toy, ignore node file, draw unit ndc quad. Create toy.frag If no --frag "
         "exists, it's content is NTOY_DEFAULT_FRAG file or predefined. Don't use this "
         "option with --geometry or positional node If you want to "
         "try node with shaders, use \"--frag fragName node.osgt\" instead.");
+    usage->addCommandLineOption("--no-program-cache",
+        "Don't cache linked program binaries on disk.");
+    usage->addCommandLineOption("--profile",
+        "Write cpu event, update, cull, draw time and gpu time of every camera to file. "
+        "json if file ends with .json, csv otherwise, csv rows are frame,metric,ms, "
+        "summary rows use min, mean, p50, p90, p99 or max as frame.");
+    usage->addCommandLineOption("--reload-delay",
+        "Milliseconds an observed file must stay unchanged before it's reloaded, changes "
+        "within it are delivered as one reload. Default 100.");
+    usage->addCommandLineOption("--reload-hash",
+        "Compare content hash of observed files, reload only if content changed.");
     usage->addCommandLineOption("--texture1d",
         "Load 1d texture, start from unit 0. You must specify name "
         "min_filter mag_filter wrap_s. It's case insensitive. e.g.\n "
@@ -145,6 +332,13 @@ int main(int argc, char* argv[])
         "Load 2d texture, start from unit 0. You must specify name "
         "min_filter mag_filter wrap_s wrap_t. It's case insensitive. e.g.\n "
         "--texture2d name linear linear repeat repeat");
+    usage->addCommandLineOption("--texture2d-pack",
+        "Add 2d image to the pack of <ntoy/pack.glsl>, repeat it for more images.");
+    usage->addCommandLineOption("--texture2d-pack-filter",
+        "min_filter mag_filter of the pack. Atlas layers have no mipmaps. Default linear "
+        "linear.");
+    usage->addCommandLineOption("--texture2d-pack-unit",
+        "Texture unit of the pack. Default 14.");
     usage->addCommandLineOption("--texture3d",
         "Load 3d texture, start from unit 0. You must specify name "
         "min_filter mag_filter wrap_s wrap_t wrap_r. It's case insensitive. e.g.\n "
@@ -173,21 +367,83 @@ int main(int argc, char* argv[])
         return 1;
     }
 
+    // bricking a volume needs no window.
+    if (args.find("--brick-volume") != -1)
+    {
+        return ntoy::NodeToy::brickVolume(args) ? 0 : 1;
+    }
+
     toy::ToyViewer viewer;
     viewer.addEventHandler(new toy::ViewerDebugHandler(&viewer));
 
+    // bench renders headless at fixed resolution.
+    toy::BenchSettings bench;
+    if (args.read("--bench", bench.warmupFrames, bench.measuredFrames))
+    {
+        args.read("--bench-dt", bench.dt);
+        args.read("--bench-tolerance", bench.tolerance);
+        args.read("--bench-baseline", bench.baselineFile);
+        args.read("--bench-save", bench.saveFile);
+        viewer.setBench(bench);
+    }
+
+    if (args.read("--headless") || bench.measuredFrames > 0)
+    {
+        int width = 1280;
+        int height = 720;
+        args.read("--headless-size", width, height);
+        if (!viewer.setUpHeadless(width, height))
+        {
+            return 1;
+        }
+    }
+
+    std::string profileFile;
+    if (args.read("--profile", profileFile) && !viewer.startProfiler(profileFile))
+    {
+        return 1;
+    }
+
     viewer.realize();
 
     ntoy::NodeToy toy(args, &viewer);
 
+    // moving time restarts accumulation every frame, F9 resumes it.
+    if (toy.isAccumulating())
+    {
+        viewer.setPause(true);
+    }
+
+    // paused and unchanged toy is neither drawn nor swapped.
+    if (!args.read("--continuous"))
+    {
+        viewer.setRunFrameScheme(osgViewer::ViewerBase::ON_DEMAND);
+        viewer.setNeedFrameCallback([&toy]() { return toy.needsFrame(); });
+        viewer.setPollCallback([&toy]() { toy.poll(); });
+    }
+
+    if (bench.measuredFrames > 0)
+    {
+        bench.ready = [&toy]() { return toy.isSceneReady(); };
+        viewer.setBench(bench);
+    }
+
+    // let observed files and node reader wake an idle on demand viewer
+    auto& pacer = viewer.getFramePacer();
+    pacer.addFileDescriptor(toy.getObserver()->getFileWatcher()->getFileDescriptor());
+    toy.setWakeCallback([&pacer](double delay) { pacer.wakeAt(pacer.now() + delay); });
+
     auto root = toy.getRoot();
     root->addEventCallback(new ntoy::NodeToyEventHandler(&toy));
 
     viewer.setSceneData(root);
-    viewer.addEventHandler(new osgGA::StateSetManipulator(root->getOrCreateStateSet()));
-    viewer.addEventHandler(new osgViewer::StatsHandler);
-    viewer.addEventHandler(new osgViewer::HelpHandler(usage));
-    viewer.addEventHandler(new osgViewer::ScreenCaptureHandler);
+    if (!viewer.getHeadless())
+    {
+        viewer.addEventHandler(new osgGA::StateSetManipulator(root->getOrCreateStateSet()));
+        viewer.addEventHandler(new osgViewer::StatsHandler);
+        viewer.addEventHandler(new osgViewer::HelpHandler(usage));
+        viewer.addEventHandler(new osgViewer::ScreenCaptureHandler);
+    }
 
     args.reportRemainingOptionsAsUnrecognized();
     if (args.errors())